@@ -0,0 +1,98 @@
+//--------------------------------------------------------
+//  Zelda Classic
+//
+//  benchmark.cpp
+//
+//  Headless game loop timing.
+//
+//--------------------------------------------------------
+
+#include "precompiled.h" //always first
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <algorithm>
+#include <vector>
+#include "zc_alleg.h"
+#include "benchmark.h"
+#include "zc_thread.h"
+
+bool headless = false;
+
+static int frames_wanted = 0;
+static std::vector<unsigned long> frame_times; // Microseconds
+static unsigned long long frame_started = 0;
+
+void benchmark_start(int frames)
+{
+    frames_wanted = frames;
+    frame_times.clear();
+    frame_times.reserve(frames);
+}
+
+bool benchmark_running()
+{
+    return frames_wanted > 0;
+}
+
+void benchmark_frame_start()
+{
+    frame_started = zc_clock_us();
+}
+
+bool benchmark_frame_end()
+{
+    if(!frames_wanted)
+        return false;
+        
+    frame_times.push_back((unsigned long)(zc_clock_us() - frame_started));
+    return (int)frame_times.size() >= frames_wanted;
+}
+
+// Times are sorted by the time this is called.
+static unsigned long percentile(int p)
+{
+    size_t i = (frame_times.size() - 1) * p / 100;
+    return frame_times[i];
+}
+
+static void report(const char *format, ...)
+{
+    char buf[256];
+    va_list ap;
+    va_start(ap, format);
+    vsprintf(buf, format, ap);
+    va_end(ap);
+    
+    printf("%s", buf);
+    al_trace("%s", buf);
+}
+
+void benchmark_report()
+{
+    if(!frames_wanted)
+        return;
+        
+    if(frame_times.empty())
+    {
+        report("Benchmark: no frames were run\n");
+        return;
+    }
+    
+    unsigned long long total = 0;
+    
+    for(size_t i = 0; i < frame_times.size(); i++)
+        total += frame_times[i];
+        
+    std::sort(frame_times.begin(), frame_times.end());
+    
+    report("Benchmark: %d frames in %.3f s, %.1f frames/sec\n", (int)frame_times.size(), total / 1000000.0,
+           total ? frame_times.size() * 1000000.0 / total : 0.0);
+    report("Frame time (us): min %lu, p50 %lu, p90 %lu, p99 %lu, max %lu\n", frame_times.front(), percentile(50),
+           percentile(90), percentile(99), frame_times.back());
+           
+    if((int)frame_times.size() < frames_wanted)
+        report("Benchmark: the game ended after %d of %d frames\n", (int)frame_times.size(), frames_wanted);
+        
+    fflush(stdout);
+}
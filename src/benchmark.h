@@ -0,0 +1,22 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+// Times the game loop for a fixed number of frames and reports how fast it
+// ran. "-benchmark <frames>" runs without a window, sound or throttling,
+// so the save slot has to be given with -load or -slot; input comes from
+// a recording given with -replay, if any.
+
+extern bool headless;
+
+void benchmark_start(int frames);
+bool benchmark_running();
+
+// Call around each frame. benchmark_frame_end() returns true once the
+// requested number of frames has been timed.
+void benchmark_frame_start();
+bool benchmark_frame_end();
+
+// Prints the results to stdout and the log.
+void benchmark_report();
+
+#endif
@@ -10,6 +10,11 @@
 
 #include "precompiled.h" //always first
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLORS_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "zc_alleg.h"
 #include "colors.h"
 
@@ -439,6 +444,62 @@ void create_zc_trans_table(COLOR_MAP *table, AL_CONST PALETTE pal, int r, int g,
     unsigned char *p;
     RGB c;
     
+    if(rgb_map)
+    {
+        // Every sum below is at most 63, so the rgb_map index of each
+        // entry fits in 15 bits and eight of them are worked out at once.
+        short tr[PAL_SIZE], tg[PAL_SIZE], tb[PAL_SIZE];
+        const unsigned char *map = &rgb_map->data[0][0][0];
+        
+        for(x=0; x<PAL_SIZE; x++)
+        {
+            tr[x] = pal[x].r * (255-r) / 255;
+            tg[x] = pal[x].g * (255-g) / 255;
+            tb[x] = pal[x].b * (255-b) / 255;
+        }
+        
+        for(x=0; x<PAL_SIZE; x++)
+        {
+            i = pal[x].r * r / 255;
+            j = pal[x].g * g / 255;
+            k = pal[x].b * b / 255;
+            p = table->data[x];
+            
+#ifdef COLORS_SSE2
+            const __m128i vi = _mm_set1_epi16((short)i);
+            const __m128i vj = _mm_set1_epi16((short)j);
+            const __m128i vk = _mm_set1_epi16((short)k);
+            
+            for(y=0; y<PAL_SIZE; y+=8)
+            {
+                __m128i vr = _mm_srli_epi16(_mm_add_epi16(vi, _mm_loadu_si128((const __m128i*)(tr+y))), 1);
+                __m128i vg = _mm_srli_epi16(_mm_add_epi16(vj, _mm_loadu_si128((const __m128i*)(tg+y))), 1);
+                __m128i vb = _mm_srli_epi16(_mm_add_epi16(vk, _mm_loadu_si128((const __m128i*)(tb+y))), 1);
+                __m128i idx = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(vr, 10), _mm_slli_epi16(vg, 5)), vb);
+                
+                p[y]   = map[_mm_extract_epi16(idx, 0)];
+                p[y+1] = map[_mm_extract_epi16(idx, 1)];
+                p[y+2] = map[_mm_extract_epi16(idx, 2)];
+                p[y+3] = map[_mm_extract_epi16(idx, 3)];
+                p[y+4] = map[_mm_extract_epi16(idx, 4)];
+                p[y+5] = map[_mm_extract_epi16(idx, 5)];
+                p[y+6] = map[_mm_extract_epi16(idx, 6)];
+                p[y+7] = map[_mm_extract_epi16(idx, 7)];
+            }
+            
+#else
+            
+            for(y=0; y<PAL_SIZE; y++)
+            {
+                p[y] = map[(((i+tr[y])>>1)<<10) | (((j+tg[y])>>1)<<5) | ((k+tb[y])>>1)];
+            }
+            
+#endif
+        }
+        
+        return;
+    }
+    
     for(x=0; x<256; x++)
     {
         tmp[x*3]   = pal[x].r * (255-r) / 255;
@@ -455,25 +516,12 @@ void create_zc_trans_table(COLOR_MAP *table, AL_CONST PALETTE pal, int r, int g,
         p = table->data[x];
         q = tmp;
         
-        if(rgb_map)
-        {
-            for(y=0; y<PAL_SIZE; y++)
-            {
-                c.r = i + *(q++);
-                c.g = j + *(q++);
-                c.b = k + *(q++);
-                p[y] = rgb_map->data[c.r>>1][c.g>>1][c.b>>1];
-            }
-        }
-        else
+        for(y=0; y<PAL_SIZE; y++)
         {
-            for(y=0; y<PAL_SIZE; y++)
-            {
-                c.r = i + *(q++);
-                c.g = j + *(q++);
-                c.b = k + *(q++);
-                p[y] = bestfit_color(pal, c.r, c.g, c.b);
-            }
+            c.r = i + *(q++);
+            c.g = j + *(q++);
+            c.b = k + *(q++);
+            p[y] = bestfit_color(pal, c.r, c.g, c.b);
         }
     }
 }
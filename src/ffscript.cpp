@@ -10,6 +10,14 @@
 #include <sstream>
 #include <math.h>
 #include <cstdio>
+#include <ctime>
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
 
 #include "ffasm.h"
 #include "zc_sys.h"
@@ -27,6 +35,8 @@ zquestheader ZCheader;
 //extern int directItemB = -1;
 
 #include "guys.h"
+#include "particles.h"
+#include "subscr.h"
 
 #include "gamedata.h"
 #include "zc_init.h"
@@ -915,6 +925,8 @@ public:
     }
 };
 
+static void free_local_array(const long ptrval);
+
 // Called when leaving a screen; deallocate arrays created by FFCs that aren't carried over
 void deallocateArray(const long ptrval)
 {
@@ -929,7 +941,7 @@ void deallocateArray(const long ptrval)
         else
         {
             word size = localRAM[ptrval].Size();
-            localRAM[ptrval].Clear();
+            free_local_array(ptrval);
             
             // If this happens once per frame, it can drown out every other message. -L
             //Z_eventlog("Deallocated local array with address %ld, size %d\n", ptrval, size);
@@ -1012,7 +1024,7 @@ int get_screen_d(long index1, long index2)
         return 0;
     }
     
-    return game->screen_d[index1][index2];
+    return game->screen_d.get(index1, index2);
 }
 
 void set_screen_d(long index1, long index2, int val)
@@ -1023,7 +1035,7 @@ void set_screen_d(long index1, long index2, int val)
         return;
     }
     
-    game->screen_d[index1][index2] = val;
+    game->screen_d.set(index1, index2, val);
 }
 
 // If scr is currently being used as a layer, return that layer no.
@@ -1041,8 +1053,243 @@ int whichlayer(long scr)
 sprite *s;
 
 
+///----------------------------------------------------------------------------------------------------//
+//                                       Script profiler                                               //
+///----------------------------------------------------------------------------------------------------//
 
-long get_register(const long arg)
+// Counts executions and accumulated CPU ticks per opcode, per register read or written through
+// get_register()/set_register(), and per script. Times are inclusive: an opcode's ticks include
+// the register accesses it makes, and a script's ticks include all of its opcodes. Local array
+// allocation churn and the reuse of array storage are reported as well.
+
+bool script_profiling = false;
+
+struct script_profile
+{
+    dword count;
+    unsigned long long ticks;
+};
+
+static script_profile opcode_profile[NUMCOMMANDS];
+static script_profile getter_profile[NUMVARIABLES];
+static script_profile setter_profile[NUMVARIABLES];
+static std::map<std::pair<byte, word>, script_profile> script_profiles;
+
+static INLINE unsigned long long profiler_ticks()
+{
+#if defined(_MSC_VER) || defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    return clock();
+#endif
+}
+
+static INLINE void add_profile_sample(script_profile *table, const long size, const long id, const unsigned long long start)
+{
+    if(id < 0 || id >= size)
+        return;
+        
+    ++table[id].count;
+    table[id].ticks += profiler_ticks() - start;
+}
+
+static void add_script_profile_sample(const byte type, const word script, const unsigned long long start)
+{
+    script_profile &p = script_profiles[std::make_pair(type, script)];
+    ++p.count;
+    p.ticks += profiler_ticks() - start;
+}
+
+// Free local array pointers, kept as a stack so that allocation doesn't have to search
+// localRAM. The lowest pointers are handed out first after a reset, as they were before.
+static word local_array_free[MAX_ZCARRAY_SIZE];
+static word local_array_free_count = 0;
+static word local_arrays_in_use = 0;
+
+// Allocation churn, reported by the script profiler.
+static script_profile local_array_allocs;
+static script_profile local_array_frees;
+static word local_arrays_peak = 0;
+
+void reset_local_arrays()
+{
+    local_array_free_count = 0;
+    
+    //localRAM[0] is used as an invalid container, so 0 can be the NULL pointer in ZScript
+    for(word i = MAX_ZCARRAY_SIZE - 1; i > 0; i--)
+    {
+        if(localRAM[i].Size() == 0)
+            local_array_free[local_array_free_count++] = i;
+    }
+    
+    local_arrays_in_use = MAX_ZCARRAY_SIZE - 1 - local_array_free_count;
+}
+
+static word alloc_local_array()
+{
+    if(local_array_free_count == 0)
+        return 0;
+        
+    word ptrval = local_array_free[--local_array_free_count];
+    
+    if(++local_arrays_in_use > local_arrays_peak)
+        local_arrays_peak = local_arrays_in_use;
+        
+    ++local_array_allocs.count;
+    return ptrval;
+}
+
+static void free_local_array(const long ptrval)
+{
+    localRAM[ptrval].Clear();
+    local_array_free[local_array_free_count++] = (word)ptrval;
+    --local_arrays_in_use;
+    ++local_array_frees.count;
+}
+
+void start_script_profiler()
+{
+    memset(opcode_profile, 0, sizeof(opcode_profile));
+    memset(getter_profile, 0, sizeof(getter_profile));
+    memset(setter_profile, 0, sizeof(setter_profile));
+    script_profiles.clear();
+    memset(&local_array_allocs, 0, sizeof(local_array_allocs));
+    memset(&local_array_frees, 0, sizeof(local_array_frees));
+    local_arrays_peak = local_arrays_in_use;
+    ZScriptArray::ResetPoolStats();
+    script_profiling = true;
+    Z_message("Script profiler started\n");
+}
+
+struct script_profile_row
+{
+    const char *category;
+    std::string name;
+    long id;
+    script_profile p;
+    
+    bool operator<(const script_profile_row &other) const
+    {
+        return p.ticks > other.p.ticks; //Most expensive first
+    }
+};
+
+static void add_profile_rows(std::vector<script_profile_row> &rows, const char *category, const script_profile *table, const long size)
+{
+    for(long i = 0; i < size; i++)
+    {
+        if(table[i].count == 0)
+            continue;
+            
+        script_profile_row row;
+        row.category = category;
+        row.id = i;
+        row.p = table[i];
+        rows.push_back(row);
+    }
+}
+
+static void add_array_row(std::vector<script_profile_row> &rows, const long id, const char *name, const dword count, const unsigned long long ticks)
+{
+    if(count == 0)
+        return;
+        
+    script_profile_row row;
+    row.category = "array";
+    row.name = name;
+    row.id = id;
+    row.p.count = count;
+    row.p.ticks = ticks;
+    rows.push_back(row);
+}
+
+static const char *script_type_name(const byte type)
+{
+    switch(type)
+    {
+    case SCRIPT_GLOBAL: return "global";
+    case SCRIPT_FFC:    return "ffc";
+    case SCRIPT_SCREEN: return "screen";
+    case SCRIPT_LINK:   return "link";
+    case SCRIPT_ITEM:   return "item";
+    case SCRIPT_LWPN:   return "lweapon";
+    case SCRIPT_NPC:    return "npc";
+    case SCRIPT_EWPN:   return "eweapon";
+    default:            return "unknown";
+    }
+}
+
+// Writes the report as CSV, one section per category, each sorted by accumulated ticks.
+// Opcodes and registers are listed by their ZASM numbers (see ffscript.h); scripts by the
+// name they were assigned with in ZQuest when the quest recorded one.
+void stop_script_profiler(const char *filename)
+{
+    if(!script_profiling)
+        return;
+        
+    script_profiling = false;
+    
+    FILE *f = fopen(filename, "w");
+    
+    if(!f)
+    {
+        Z_message("Unable to write script profile to %s\n", filename);
+        return;
+    }
+    
+    std::vector<script_profile_row> scripts, opcodes, registers, arrays;
+    
+    for(std::map<std::pair<byte, word>, script_profile>::iterator it = script_profiles.begin(); it != script_profiles.end(); ++it)
+    {
+        script_profile_row row;
+        row.category = script_type_name(it->first.first);
+        row.id = it->first.second;
+        row.p = it->second;
+        
+        std::map<int, std::pair<string,string> > *names = NULL;
+        
+        if(it->first.first == SCRIPT_FFC)         names = &ffcmap;
+        else if(it->first.first == SCRIPT_ITEM)   names = &itemmap;
+        else if(it->first.first == SCRIPT_GLOBAL) names = &globalmap;
+        
+        if(names && names->find(row.id - 1) != names->end())
+            row.name = (*names)[row.id - 1].second;
+            
+        scripts.push_back(row);
+    }
+    
+    add_profile_rows(opcodes, "opcode", opcode_profile, NUMCOMMANDS);
+    add_profile_rows(registers, "get", getter_profile, NUMVARIABLES);
+    add_profile_rows(registers, "set", setter_profile, NUMVARIABLES);
+    std::sort(scripts.begin(), scripts.end());
+    std::sort(opcodes.begin(), opcodes.end());
+    std::sort(registers.begin(), registers.end());
+    
+    const ZScriptArray::PoolStats &pool = ZScriptArray::GetPoolStats();
+    add_array_row(arrays, 0, "local allocations", local_array_allocs.count, local_array_allocs.ticks);
+    add_array_row(arrays, 1, "local deallocations", local_array_frees.count, local_array_frees.ticks);
+    add_array_row(arrays, 2, "peak local arrays", local_arrays_peak, 0);
+    add_array_row(arrays, 3, "storage blocks allocated", pool.allocs, 0);
+    add_array_row(arrays, 4, "storage blocks reused", pool.reused, 0);
+    add_array_row(arrays, 5, "storage blocks freed", pool.frees, 0);
+    
+    fprintf(f, "category,id,name,count,ticks,ticks_per_call\n");
+    std::vector<script_profile_row> *sections[4] = { &scripts, &opcodes, &registers, &arrays };
+    
+    for(int i = 0; i < 4; i++)
+    {
+        for(std::vector<script_profile_row>::iterator it = sections[i]->begin(); it != sections[i]->end(); ++it)
+        {
+            fprintf(f, "%s,%ld,\"%s\",%lu,%llu,%llu\n", it->category, it->id, it->name.c_str(),
+                    (unsigned long)it->p.count, it->p.ticks, it->p.ticks / it->p.count);
+        }
+    }
+    
+    fclose(f);
+    Z_message("Script profile written to %s\n", filename);
+}
+
+static long read_register(const long arg)
 {
 
     long ret = 0;
@@ -4789,7 +5036,7 @@ case MAPDATAMISCD:
 	}
 	else 
 	{
-	    ret = (game->screen_d[ri->mapsref][indx]) * 10000;
+	    ret = game->screen_d.get(ri->mapsref, indx) * 10000;
 	    break;
 	}
 }
@@ -5971,10 +6218,21 @@ case AUDIOPAN:
     return ret;
 }
 
+long get_register(const long arg)
+{
+    if(!script_profiling)
+        return read_register(arg);
+        
+    const unsigned long long start = profiler_ticks();
+    const long ret = read_register(arg);
+    add_profile_sample(getter_profile, NUMVARIABLES, arg, start);
+    return ret;
+}
+
 //Setter Instructions
 
 
-void set_register(const long arg, const long value)
+static void write_register(const long arg, const long value)
 {
 	//Macros
 	
@@ -8785,6 +9043,7 @@ if(GuyH::loadNPC(ri->guyref, str) == SH::_NoError) \
             }
             
             combobuf[tmpscr->data[pos]].type=value/10000;
+            combo_walkflags_changed();
             
             for(int i = 0; i < 176; i++)
             {
@@ -8811,7 +9070,10 @@ if(GuyH::loadNPC(ri->guyref, str) == SH::_NoError) \
         int pos = (ri->d[0])/10000;
         
         if(pos >= 0 && pos < 176)
+        {
             combobuf[tmpscr->data[pos]].walk=(value/10000)&15;
+            combo_walkflags_changed();
+        }
     }
     break;
     
@@ -8914,6 +9176,7 @@ case COMBODDM:
         }
         
         combobuf[cdata].type=value/10000;
+        combo_walkflags_changed();
         
         for(int i = 0; i < 176; i++)
         {
@@ -8949,7 +9212,8 @@ case COMBODDM:
 
 		if(pos < 0 || pos >= 176 || scr < 0) break;
 
-		combobuf[TheMaps[scr].data[pos]].walk=(value/10000)&15;	    
+		combobuf[TheMaps[scr].data[pos]].walk=(value/10000)&15;
+		combo_walkflags_changed();
     }
     break;
     
@@ -10002,7 +10266,7 @@ case MAPDATAMISCD:
 	}
 	else 
 	{
-		game->screen_d[ri->mapsref][indx] = value/10000;
+		game->screen_d.set(ri->mapsref, indx, value/10000);
 		break;
 	}
 }
@@ -10059,6 +10323,7 @@ case MAPDATAMISCD:
             }
             
             combobuf[m->data[pos]].type=value/10000;
+            combo_walkflags_changed();
             
             for(int i = 0; i < 176; i++)
             {
@@ -10085,7 +10350,10 @@ case MAPDATAMISCD:
         int pos = (ri->d[0])/10000;
         mapscr *m = &TheMaps[ri->mapsref];
         if(pos >= 0 && pos < 176)
+        {
             combobuf[m->data[pos]].walk=(value/10000)&15;
+            combo_walkflags_changed();
+        }
     }
     break;
 
@@ -10672,12 +10940,12 @@ case MESSAGEDATAFLAGS: //BYTE
 //NEWCOMBO STRUCT
 case COMBODTILE:	SET_COMBO_VAR_DWORD(tile, "Tile"); break;						//word
 case COMBODFLIP:	SET_COMBO_VAR_BYTE(flip, "Flip"); break;						//char
-case COMBODWALK:	SET_COMBO_VAR_BYTE(walk, "Walk"); break;						//char
-case COMBODTYPE:	SET_COMBO_VAR_BYTE(type, "Type"); break;						//char
+case COMBODWALK:	SET_COMBO_VAR_BYTE(walk, "Walk"); combo_walkflags_changed(); break;						//char
+case COMBODTYPE:	SET_COMBO_VAR_BYTE(type, "Type"); combo_walkflags_changed(); break;						//char
 case COMBODCSET:	SET_COMBO_VAR_BYTE(csets, "CSet"); break;						//C
 case COMBODFOO:		SET_COMBO_VAR_DWORD(foo, "Foo"); break;							//W
 case COMBODFRAMES:	SET_COMBO_VAR_BYTE(frames, "Frames"); break;						//C
-case COMBODNEXTD:	SET_COMBO_VAR_DWORD(speed, "NextData"); break;						//W
+case COMBODNEXTD:	SET_COMBO_VAR_DWORD(speed, "NextData"); reschedule_combo_animation(ri->combosref); break;	//W
 case COMBODNEXTC:	SET_COMBO_VAR_BYTE(nextcombo, "NextCSet"); break;					//C
 case COMBODFLAG:	SET_COMBO_VAR_BYTE(nextcset, "Flag"); break;						//C
 case COMBODSKIPANIM:	SET_COMBO_VAR_BYTE(skipanim, "SkipAnim"); break;					//C
@@ -10750,7 +11018,7 @@ case COMBODWARPTYPE:		SET_COMBOCLASS_VAR_BYTE(warp_type, "Warp"); break;				//C
 case COMBODWARPSENS:		SET_COMBOCLASS_VAR_BYTE(warp_sensitive,	"WarpSensitivity"); break; 		//C
 case COMBODWARPDIRECT:		SET_COMBOCLASS_VAR_BYTE(warp_direct, "WarpDirect"); break;			//C
 case COMBODWARPLOCATION:	SET_COMBOCLASS_VAR_BYTE(warp_location, "WarpLocation"); break;			//C
-case COMBODWATER:		SET_COMBOCLASS_VAR_BYTE(water, "Water"); break;					//C
+case COMBODWATER:		SET_COMBOCLASS_VAR_BYTE(water, "Water"); combo_walkflags_changed(); break;					//C
 case COMBODWHISTLE:		SET_COMBOCLASS_VAR_BYTE(whistle, "Whistle"); break;				//C
 case COMBODWINGAME:		SET_COMBOCLASS_VAR_BYTE(win_game, "WinGame"); break; 				//C
 case COMBODBLOCKWPNLEVEL:	SET_COMBOCLASS_VAR_BYTE(block_weapon_lvl, "BlockWeaponLevel"); break;		//C
@@ -11220,7 +11488,20 @@ case AUDIOPAN:
         break;
     }
     }
-} //end set_register
+} //end write_register
+
+void set_register(const long arg, const long value)
+{
+    if(!script_profiling)
+    {
+        write_register(arg, value);
+        return;
+    }
+    
+    const unsigned long long start = profiler_ticks();
+    write_register(arg, value);
+    add_profile_sample(setter_profile, NUMVARIABLES, arg, start);
+}
 
 ///----------------------------------------------------------------------------------------------------//
 //                                       ASM Functions                                                 //
@@ -11301,26 +11582,26 @@ void do_allocatemem(const bool v, const bool local, const byte i)
     
     if(local)
     {
-        //localRAM[0] is used as an invalid container, so 0 can be the NULL pointer in ZScript
-        for(ptrval = 1; localRAM[ptrval].Size() != 0; ptrval++) ;
+        unsigned long long start = script_profiling ? profiler_ticks() : 0;
+        ptrval = alloc_local_array();
         
-        if(ptrval >= MAX_ZCARRAY_SIZE)
+        if(ptrval == 0)
         {
             Z_scripterrlog("%d local arrays already in use, no more can be allocated\n", MAX_ZCARRAY_SIZE-1);
-            ptrval = 0;
         }
         else
         {
             ZScriptArray &a = localRAM[ptrval]; //marginally faster for large arrays if we use a reference
             
             a.Resize(size);
+            a.Assign(0, size, 0); //initialize array
             
-            for(dword j = 0; j < (dword)size; j++)
-                a[j] = 0; //initialize array
-                
             // Keep track of which FFC created the array so we know which to deallocate when changing screens
             arrayOwner[ptrval]=i;
         }
+        
+        if(script_profiling)
+            local_array_allocs.ticks += profiler_ticks() - start;
     }
     else
     {
@@ -11336,9 +11617,7 @@ void do_allocatemem(const bool v, const bool local, const byte i)
         ZScriptArray &a = game->globalRAM[ptrval];
         
         a.Resize(size);
-        
-        for(dword j = 0; j < (dword)size; j++)
-            a[j] = 0;
+        a.Assign(0, size, 0);
             
         ptrval += MAX_ZCARRAY_SIZE; //so each pointer has a unique value
     }
@@ -11354,8 +11633,12 @@ void do_allocatemem(const bool v, const bool local, const byte i)
 void do_deallocatemem()
 {
     const long ptrval = get_register(sarg1) / 10000;
+    unsigned long long start = script_profiling ? profiler_ticks() : 0;
     
     FFScript::deallocateZScriptArray(ptrval);
+    
+    if(script_profiling)
+        local_array_frees.ticks += profiler_ticks() - start;
 }
 
 void do_loada(const byte a)
@@ -12615,6 +12898,7 @@ void do_clearsprites(const bool v)
         
     case 5:
         particles.clear();
+        clear_pooled_particles();
         break;
     }
 }
@@ -13394,6 +13678,8 @@ void do_drawing_command(const int script_command)
     
     
     }
+    
+    script_drawing_commands.Submit(j);
 }
 
 void do_set_rendertarget(bool)
@@ -13934,6 +14220,7 @@ void do_copytile(const bool v, const bool v2)
     long tile2 = SH::get_arg(sarg2, v2) / 10000;
     
     copy_tile(newtilebuf, tile, tile2, false);
+    invalidate_passive_subscr();
 }
 
 void do_swaptile(const bool v, const bool v2)
@@ -13942,6 +14229,7 @@ void do_swaptile(const bool v, const bool v2)
     long tile2 = SH::get_arg(sarg2, v2) / 10000;
     
     copy_tile(newtilebuf, tile, tile2, true);
+    invalidate_passive_subscr();
 }
 
 void do_overlaytile(const bool v, const bool v2)
@@ -13955,6 +14243,7 @@ void do_overlaytile(const bool v, const bool v2)
         
     //Could add an arg for the CSet or something instead of just passing 0, currently only 8-bit is supported
     overlay_tile(newtilebuf, tile, tile2, 0, false);
+    invalidate_passive_subscr();
 }
 
 void do_fliprotatetile(const bool v, const bool v2)
@@ -14009,6 +14298,7 @@ void do_cleartile(const bool v)
         return;
         
     reset_tile(newtilebuf, tile, newtilebuf[tile].format);
+    invalidate_passive_subscr();
 }
 
 void do_combotile(const bool v)
@@ -14022,6 +14312,301 @@ void do_combotile(const bool v)
 }
 
 
+///----------------------------------------------------------------------------------------------------//
+//                                       Pre-decoded ZASM                                              //
+///----------------------------------------------------------------------------------------------------//
+
+// Each ffscript array is decoded once, the first time it is run, into a parallel stream of
+// handler pointers. Hot instructions dispatch through the handler instead of the command switch,
+// and their D/A register operands are resolved to an offset into refInfo so they skip the
+// get_register()/set_register() switch. A NULL handler means "use the switch in run_script()".
+
+struct zasm_arg
+{
+    long raw;   //the original arg1/arg2
+    int offset; //byte offset of the register in refInfo, or -1 for get_register()/set_register()
+};
+
+struct zasm_op;
+typedef void (*zasm_handler)(const zasm_op &op, dword &pc, bool &increment);
+
+struct zasm_op
+{
+    zasm_handler handler;
+    zasm_arg arg1, arg2;
+};
+
+static std::map<const ffscript*, std::vector<zasm_op> > decodedScripts;
+
+void clear_decoded_scripts()
+{
+    decodedScripts.clear();
+}
+
+static INLINE long zasm_get(const zasm_arg &a)
+{
+    if(a.offset >= 0)
+        return *(long*)((char*)ri + a.offset);
+
+    return get_register(a.raw);
+}
+
+static INLINE void zasm_set(const zasm_arg &a, const long value)
+{
+    if(a.offset >= 0)
+        *(long*)((char*)ri + a.offset) = value;
+    else
+        set_register(a.raw, value);
+}
+
+// These mirror the do_*() functions and switch cases they replace, operation for operation.
+static void zasm_setv(const zasm_op &op, dword &, bool &)
+{
+    zasm_set(op.arg1, op.arg2.raw);
+}
+
+static void zasm_setr(const zasm_op &op, dword &, bool &)
+{
+    zasm_set(op.arg1, zasm_get(op.arg2));
+}
+
+static void zasm_addv(const zasm_op &op, dword &, bool &)
+{
+    long temp2 = zasm_get(op.arg1);
+    zasm_set(op.arg1, temp2 + op.arg2.raw);
+}
+
+static void zasm_addr(const zasm_op &op, dword &, bool &)
+{
+    long temp = zasm_get(op.arg2);
+    long temp2 = zasm_get(op.arg1);
+    zasm_set(op.arg1, temp2 + temp);
+}
+
+static void zasm_subv(const zasm_op &op, dword &, bool &)
+{
+    long temp2 = zasm_get(op.arg1);
+    zasm_set(op.arg1, temp2 - op.arg2.raw);
+}
+
+static void zasm_subr(const zasm_op &op, dword &, bool &)
+{
+    long temp = zasm_get(op.arg2);
+    long temp2 = zasm_get(op.arg1);
+    zasm_set(op.arg1, temp2 - temp);
+}
+
+static INLINE void zasm_mult(const zasm_arg &a, long long temp)
+{
+    long temp2 = zasm_get(a);
+    zasm_set(a, long((temp * temp2) / 10000));
+}
+
+static void zasm_multv(const zasm_op &op, dword &, bool &)
+{
+    zasm_mult(op.arg1, op.arg2.raw);
+}
+
+static void zasm_multr(const zasm_op &op, dword &, bool &)
+{
+    zasm_mult(op.arg1, zasm_get(op.arg2));
+}
+
+static INLINE void zasm_comp(const long temp, const long temp2)
+{
+    if(temp2 >= temp)   ri->scriptflag |= MOREFLAG;
+    else                ri->scriptflag &= ~MOREFLAG;
+
+    if(temp2 == temp)   ri->scriptflag |= TRUEFLAG;
+    else                ri->scriptflag &= ~TRUEFLAG;
+}
+
+static void zasm_comparev(const zasm_op &op, dword &, bool &)
+{
+    zasm_comp(op.arg2.raw, zasm_get(op.arg1));
+}
+
+static void zasm_comparer(const zasm_op &op, dword &, bool &)
+{
+    long temp = zasm_get(op.arg2);
+    zasm_comp(temp, zasm_get(op.arg1));
+}
+
+static void zasm_goto(const zasm_op &op, dword &pc, bool &increment)
+{
+    pc = op.arg1.raw;
+    increment = false;
+}
+
+static void zasm_gototrue(const zasm_op &op, dword &pc, bool &increment)
+{
+    if(ri->scriptflag & TRUEFLAG)
+    {
+        pc = op.arg1.raw;
+        increment = false;
+    }
+}
+
+static void zasm_gotofalse(const zasm_op &op, dword &pc, bool &increment)
+{
+    if(!(ri->scriptflag & TRUEFLAG))
+    {
+        pc = op.arg1.raw;
+        increment = false;
+    }
+}
+
+static void zasm_gotomore(const zasm_op &op, dword &pc, bool &increment)
+{
+    if(ri->scriptflag & MOREFLAG)
+    {
+        pc = op.arg1.raw;
+        increment = false;
+    }
+}
+
+static void zasm_gotoless(const zasm_op &op, dword &pc, bool &increment)
+{
+    if(!(ri->scriptflag & MOREFLAG) || (!get_bit(quest_rules,qr_GOTOLESSNOTEQUAL) && (ri->scriptflag & TRUEFLAG)))
+    {
+        pc = op.arg1.raw;
+        increment = false;
+    }
+}
+
+static void zasm_settrue(const zasm_op &op, dword &, bool &)
+{
+    zasm_set(op.arg1, (ri->scriptflag & TRUEFLAG) ? 1 : 0);
+}
+
+static void zasm_setfalse(const zasm_op &op, dword &, bool &)
+{
+    zasm_set(op.arg1, (ri->scriptflag & TRUEFLAG) ? 0 : 1);
+}
+
+static void zasm_setmore(const zasm_op &op, dword &, bool &)
+{
+    zasm_set(op.arg1, (ri->scriptflag & MOREFLAG) ? 1 : 0);
+}
+
+static void zasm_setless(const zasm_op &op, dword &, bool &)
+{
+    zasm_set(op.arg1, (!(ri->scriptflag & MOREFLAG)
+                       || (ri->scriptflag & TRUEFLAG)) ? 1 : 0);
+}
+
+static void zasm_pushv(const zasm_op &op, dword &, bool &)
+{
+    ri->sp--;
+    SH::write_stack(ri->sp, op.arg1.raw);
+}
+
+static void zasm_pushr(const zasm_op &op, dword &, bool &)
+{
+    const long value = zasm_get(op.arg1);
+    ri->sp--;
+    SH::write_stack(ri->sp, value);
+}
+
+static void zasm_pop(const zasm_op &op, dword &, bool &)
+{
+    const long value = SH::read_stack(ri->sp);
+    ri->sp++;
+    zasm_set(op.arg1, value);
+}
+
+static void zasm_loadi(const zasm_op &op, dword &, bool &)
+{
+    const long stackoffset = zasm_get(op.arg2) / 10000;
+    const long value = SH::read_stack(stackoffset);
+    zasm_set(op.arg1, value);
+}
+
+static void zasm_storei(const zasm_op &op, dword &, bool &)
+{
+    const long stackoffset = zasm_get(op.arg2) / 10000;
+    const long value = zasm_get(op.arg1);
+    SH::write_stack(stackoffset, value);
+}
+
+static zasm_arg decode_zasm_arg(const long raw)
+{
+    static refInfo layout;
+    zasm_arg a;
+    a.raw = raw;
+    a.offset = -1;
+
+    // Must agree with the default: case of get_register()/set_register()
+    if(raw >= D(0) && raw <= D(7))
+        a.offset = (int)((char*)&layout.d[raw - D(0)] - (char*)&layout);
+    else if(raw >= A(0) && raw <= A(1))
+        a.offset = (int)((char*)&layout.a[raw - A(0)] - (char*)&layout);
+
+    return a;
+}
+
+static zasm_handler decode_zasm_handler(const ffscript &instr)
+{
+    switch(instr.command)
+    {
+    case SETV:
+    case SETR:
+        // do_set() refuses to change the running FFC's own script; leave that to the switch
+        return instr.arg1 == FFSCRIPT ? NULL : (instr.command == SETV ? zasm_setv : zasm_setr);
+
+    case ADDV:      return zasm_addv;
+    case ADDR:      return zasm_addr;
+    case SUBV:      return zasm_subv;
+    case SUBR:      return zasm_subr;
+    case MULTV:     return zasm_multv;
+    case MULTR:     return zasm_multr;
+    case COMPAREV:  return zasm_comparev;
+    case COMPARER:  return zasm_comparer;
+    case GOTO:      return zasm_goto;
+    case GOTOTRUE:  return zasm_gototrue;
+    case GOTOFALSE: return zasm_gotofalse;
+    case GOTOMORE:  return zasm_gotomore;
+    case GOTOLESS:  return zasm_gotoless;
+    case SETTRUE:   return zasm_settrue;
+    case SETFALSE:  return zasm_setfalse;
+    case SETMORE:   return zasm_setmore;
+    case SETLESS:   return zasm_setless;
+    case PUSHV:     return zasm_pushv;
+    case PUSHR:     return zasm_pushr;
+    case POP:       return zasm_pop;
+    case LOADI:     return zasm_loadi;
+    case STOREI:    return zasm_storei;
+
+    default:
+        return NULL;
+    }
+}
+
+static const std::vector<zasm_op> &get_decoded_script(const ffscript *script)
+{
+    std::map<const ffscript*, std::vector<zasm_op> >::iterator it = decodedScripts.find(script);
+
+    if(it != decodedScripts.end())
+        return it->second;
+
+    std::vector<zasm_op> &ops = decodedScripts[script];
+
+    for(dword pc = 0; ; pc++)
+    {
+        zasm_op op;
+        op.handler = decode_zasm_handler(script[pc]);
+        op.arg1 = decode_zasm_arg(script[pc].arg1);
+        op.arg2 = decode_zasm_arg(script[pc].arg2);
+        ops.push_back(op);
+
+        if(script[pc].command == 0xFFFF)
+            break;
+    }
+
+    return ops;
+}
+
+
 ///----------------------------------------------------------------------------------------------------//
 //                                       Run the script                                                //
 ///----------------------------------------------------------------------------------------------------//
@@ -14035,20 +14620,10 @@ int run_script(const byte type, const word script, const byte i)
     curScriptType=type;
     curScriptNum=script;
     numInstructions=0;
-#ifdef _SCRIPT_COUNTER
-    dword script_timer[NUMCOMMANDS];
-    dword script_execount[NUMCOMMANDS];
-    
-    for(int j = 0; j < NUMCOMMANDS; j++)
-    {
-        script_timer[j]=0;
-        script_execount[j]=0;
-    }
-    
-    dword start_time, end_time;
     
-    script_counter = 0;
-#endif
+    const unsigned long long script_start = script_profiling ? profiler_ticks() : 0;
+    unsigned long long op_start = 0;
+    word op_command = 0;
     
     switch(type)
     {
@@ -14111,6 +14686,9 @@ int run_script(const byte type, const word script, const byte i)
         break;
     }
     
+    const std::vector<zasm_op> &decoded = get_decoded_script(curscript);
+    const dword numdecoded = decoded.size();
+    
     dword pc = ri->pc; //this is (marginally) quicker than dereferencing ri each time
     word scommand = curscript[pc].command;
     sarg1 = curscript[pc].arg1;
@@ -14160,12 +14738,17 @@ int run_script(const byte type, const word script, const byte i)
 #ifdef _FFDISSASSEMBLY
         ffdebug::print_dissassembly(scommand);
 #endif
-#ifdef _SCRIPT_COUNTER
-        start_time = script_counter;
-#endif
 #endif
         
-        switch(scommand)
+        if(script_profiling)
+        {
+            op_command = scommand;
+            op_start = profiler_ticks();
+        }
+        
+        if(scommand != 0xFFFF && pc < numdecoded && decoded[pc].handler) //0xFFFF: hang check tripped
+            decoded[pc].handler(decoded[pc], pc, increment);
+        else switch(scommand)
         {
         case QUIT:
             scommand = 0xFFFF;
@@ -15799,12 +16382,9 @@ case DMAPDATASETMUSICV: //command, string to load a music file
             Z_scripterrlog("Invalid ZASM command %ld reached\n", scommand);
             break;
         }
-               
-#ifdef _SCRIPT_COUNTER
-        end_time = script_counter;
-        script_timer[*command] += end_time - start_time;
-        ++script_execount[*command];
-#endif
+        
+        if(script_profiling)
+            add_profile_sample(opcode_profile, NUMCOMMANDS, op_command, op_start);
         
         if(increment)	pc++;
         else			increment = true;
@@ -15855,17 +16435,8 @@ case DMAPDATASETMUSICV: //command, string to load a music file
         
     ri->pc = pc; //Put it back where we got it from
     
-#ifdef _SCRIPT_COUNTER
-    
-    for(int j = 0; j < NUMCOMMANDS; j++)
-    {
-        if(script_execount[j] != 0)
-            al_trace("Command %s took %ld ticks in all to complete in %ld executions.\n",
-                     command_list[j].name, script_timer[j], script_execount[j]);
-    }
-    
-    remove_int(update_script_counter);
-#endif
+    if(script_profiling)
+        add_script_profile_sample(type, script, script_start);
     
     return 0;
 }
@@ -16377,7 +16948,7 @@ void FFScript::deallocateZScriptArray(const long ptrval)
         else
         {
             word size = localRAM[ptrval].Size();
-            localRAM[ptrval].Clear();
+            free_local_array(ptrval);
             
             // If this happens once per frame, it can drown out every other message. -L
             //Z_eventlog("Deallocated local array with address %ld, size %d\n", ptrval, size);
@@ -16394,7 +16965,7 @@ int FFScript::get_screen_d(long index1, long index2)
         return 0;
     }
     
-    return game->screen_d[index1][index2];
+    return game->screen_d.get(index1, index2);
 }
 
 void FFScript::set_screen_d(long index1, long index2, int val)
@@ -16405,7 +16976,7 @@ void FFScript::set_screen_d(long index1, long index2, int val)
         return;
     }
     
-    game->screen_d[index1][index2] = val;
+    game->screen_d.set(index1, index2, val);
 }
 
 // If scr is currently being used as a layer, return that layer no.
@@ -17182,7 +17753,7 @@ void FFScript::setComboData_warp_type(){ SET_COMBODATA_TYPE_INT(warp_type,ZS_BYT
 void FFScript::setComboData_warp_sensitive(){ SET_COMBODATA_TYPE_INT(warp_sensitive,ZS_BYTE); } //byte bd
 void FFScript::setComboData_warp_direct(){ SET_COMBODATA_TYPE_INT(warp_direct,ZS_BYTE); } //byte be
 void FFScript::setComboData_warp_location(){ SET_COMBODATA_TYPE_INT(warp_location,ZS_BYTE); } //byte bf
-void FFScript::setComboData_water(){ SET_COMBODATA_TYPE_INT(water,ZS_BYTE); } //byte bg
+void FFScript::setComboData_water(){ SET_COMBODATA_TYPE_INT(water,ZS_BYTE); combo_walkflags_changed(); } //byte bg
 void FFScript::setComboData_whistle(){ SET_COMBODATA_TYPE_INT(whistle,ZS_BYTE); } //byte bh
 void FFScript::setComboData_win_game(){ SET_COMBODATA_TYPE_INT(win_game,ZS_BYTE); } //byte bi
 void FFScript::setComboData_block_weapon_lvl(){ SET_COMBODATA_TYPE_INT(block_weapon_lvl,ZS_BYTE); } //byte bj - max level of weapon to block
@@ -17191,12 +17762,16 @@ void FFScript::setComboData_block_weapon_lvl(){ SET_COMBODATA_TYPE_INT(block_wea
 void FFScript::setComboData_tile(){ SET_COMBODATA_VAR_INT(tile,ZS_WORD); } //newcombo, word
 void FFScript::setComboData_flip(){ SET_COMBODATA_VAR_INT(flip,ZS_BYTE); } //newcombo byte
 
-void FFScript::setComboData_walk(){ SET_COMBODATA_VAR_INT(walk,ZS_BYTE); } //newcombo byte
-void FFScript::setComboData_type(){ SET_COMBODATA_VAR_INT(type,ZS_BYTE); } //newcombo byte
+void FFScript::setComboData_walk(){ SET_COMBODATA_VAR_INT(walk,ZS_BYTE); combo_walkflags_changed(); } //newcombo byte
+void FFScript::setComboData_type(){ SET_COMBODATA_VAR_INT(type,ZS_BYTE); combo_walkflags_changed(); } //newcombo byte
 void FFScript::setComboData_csets(){ SET_COMBODATA_VAR_INT(csets,ZS_BYTE); } //newcombo byte
 void FFScript::setComboData_foo(){ SET_COMBODATA_VAR_INT(foo,ZS_WORD); } //newcombo word
 void FFScript::setComboData_frames(){ SET_COMBODATA_VAR_INT(frames,ZS_BYTE); } //newcombo byte
-void FFScript::setComboData_speed(){ SET_COMBODATA_VAR_INT(speed,ZS_BYTE); } //newcombo byte
+void FFScript::setComboData_speed()
+{
+	SET_COMBODATA_VAR_INT(speed,ZS_BYTE); //newcombo byte
+	reschedule_combo_animation(get_register(sarg1) / 10000);
+}
 void FFScript::setComboData_nextcombo(){ SET_COMBODATA_VAR_INT(nextcombo,ZS_WORD); } //newcombo word
 void FFScript::setComboData_nextcset(){ SET_COMBODATA_VAR_INT(nextcset,ZS_BYTE); } //newcombo byte
 void FFScript::setComboData_flag(){ SET_COMBODATA_VAR_INT(flag,ZS_BYTE); } //newcombo byte
@@ -890,7 +890,14 @@ int ffscript_engine(const bool preload);
 
 void clear_ffc_stack(const byte i);
 void clear_global_stack();
+void clear_decoded_scripts();
+
+//Script profiler. Ctrl+F2 or the -profilescripts switch toggles it; the report is written on stop.
+extern bool script_profiling;
+void start_script_profiler();
+void stop_script_profiler(const char *filename = "zscript_profile.csv");
 void deallocateArray(const long ptrval);
+void reset_local_arrays();
 void clearScriptHelperData();
 
 void do_getscreenflags();
@@ -0,0 +1,201 @@
+//--------------------------------------------------------
+//  Zelda Classic
+//
+//  frametiming.cpp
+//
+//  Per-phase frame timing.
+//
+//--------------------------------------------------------
+
+#include "precompiled.h" //always first
+
+#include <stdio.h>
+#include <string.h>
+#include "zc_alleg.h"
+#include "zc_malloc.h"
+#include "frametiming.h"
+#include "zc_thread.h"
+#include "zsys.h"
+
+#define MAX_FRAME_EVENTS 48
+
+bool frame_timing = false;
+
+static const char *phase_names[fpMAX] =
+{
+    "global script", "ffc scripts", "animate_combos", "guys", "weapons", "link",
+    "draw_screen", "primitives", "subscreen", "updatescr", "throttle"
+};
+
+// Phases timed inside another one, which are indented in the overlay.
+static const bool phase_nested[fpMAX] =
+{
+    false, false, false, false, false, false,
+    false, true, true, false, false
+};
+
+struct frame_event
+{
+    byte phase;
+    unsigned long start; // Microseconds since the frame started
+    unsigned long duration;
+};
+
+struct frame_sample
+{
+    unsigned long long start;
+    unsigned long duration;
+    unsigned long phase[fpMAX];
+    int events;
+    frame_event event[MAX_FRAME_EVENTS];
+};
+
+static frame_sample *samples = NULL; // Ring of FRAME_TIMING_FRAMES
+static int sample_pos = 0;
+static int sample_count = 0;
+static frame_sample current;
+
+unsigned long long frame_timing_clock()
+{
+    return zc_clock_us();
+}
+
+static void begin_sample(unsigned long long now)
+{
+    memset(&current, 0, sizeof(frame_sample) - sizeof(current.event));
+    current.start = now;
+}
+
+void start_frame_timing()
+{
+    if(!samples)
+        samples = (frame_sample *)zc_malloc(sizeof(frame_sample) * FRAME_TIMING_FRAMES);
+        
+    if(!samples)
+        return;
+        
+    sample_pos = sample_count = 0;
+    begin_sample(frame_timing_clock());
+    frame_timing = true;
+    Z_message("Frame timing started\n");
+}
+
+void add_frame_phase(int phase, unsigned long long start)
+{
+    unsigned long long now = frame_timing_clock();
+    
+    // Started before the frame did; count only this frame's part of it.
+    if(start < current.start)
+        start = current.start;
+        
+    unsigned long duration = (unsigned long)(now - start);
+    current.phase[phase] += duration;
+    
+    if(current.events < MAX_FRAME_EVENTS)
+    {
+        frame_event &e = current.event[current.events++];
+        e.phase = phase;
+        e.start = (unsigned long)(start - current.start);
+        e.duration = duration;
+    }
+}
+
+void next_frame_timing()
+{
+    if(!frame_timing)
+        return;
+        
+    unsigned long long now = frame_timing_clock();
+    current.duration = (unsigned long)(now - current.start);
+    memcpy(&samples[sample_pos], &current, sizeof(frame_sample));
+    sample_pos = (sample_pos + 1) % FRAME_TIMING_FRAMES;
+    
+    if(sample_count < FRAME_TIMING_FRAMES)
+        ++sample_count;
+        
+    begin_sample(now);
+}
+
+// Returns the n'th most recent frame.
+static frame_sample &recent_sample(int n)
+{
+    return samples[(sample_pos - 1 - n + FRAME_TIMING_FRAMES) % FRAME_TIMING_FRAMES];
+}
+
+void show_frame_timing(BITMAP *target)
+{
+    if(!frame_timing || !sample_count)
+        return;
+        
+    int frames = zc_min(sample_count, 60);
+    unsigned long total[fpMAX+1], worst[fpMAX+1];
+    memset(total, 0, sizeof(total));
+    memset(worst, 0, sizeof(worst));
+    
+    for(int i = 0; i < frames; i++)
+    {
+        frame_sample &s = recent_sample(i);
+        
+        for(int p = 0; p < fpMAX; p++)
+        {
+            total[p] += s.phase[p];
+            worst[p] = zc_max(worst[p], s.phase[p]);
+        }
+        
+        total[fpMAX] += s.duration;
+        worst[fpMAX] = zc_max(worst[fpMAX], s.duration);
+    }
+    
+    int y = 0;
+    textprintf_ex(target, font, 0, y, 254, BLACK, "%-16s %6s %6s", "ms", "avg", "max");
+    
+    for(int p = 0; p <= fpMAX; p++)
+    {
+        y += 8;
+        textprintf_ex(target, font, 0, y, 254, BLACK, "%s%-*s %6.2f %6.2f",
+                      (p < fpMAX && phase_nested[p]) ? "  " : "",
+                      (p < fpMAX && phase_nested[p]) ? 14 : 16,
+                      p < fpMAX ? phase_names[p] : "frame",
+                      total[p] / 1000.0 / frames, worst[p] / 1000.0);
+    }
+}
+
+void stop_frame_timing(const char *filename)
+{
+    if(!frame_timing)
+        return;
+        
+    frame_timing = false;
+    
+    FILE *f = fopen(filename, "w");
+    
+    if(!f)
+    {
+        Z_message("Unable to write frame timing to %s\n", filename);
+        return;
+    }
+    
+    unsigned long long origin = sample_count ? recent_sample(sample_count - 1).start : 0;
+    bool first = true;
+    fprintf(f, "{\"traceEvents\":[\n");
+    
+    for(int i = sample_count - 1; i >= 0; i--)
+    {
+        frame_sample &s = recent_sample(i);
+        unsigned long long ts = s.start - origin;
+        
+        fprintf(f, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%llu,\"dur\":%lu}",
+                first ? "" : ",\n", ts, s.duration);
+        first = false;
+        
+        for(int e = 0; e < s.events; e++)
+        {
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%llu,\"dur\":%lu}",
+                    phase_names[s.event[e].phase], ts + s.event[e].start, s.event[e].duration);
+        }
+    }
+    
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    Z_message("Frame timing written to %s\n", filename);
+}
@@ -0,0 +1,48 @@
+#ifndef _FRAMETIMING_H_
+#define _FRAMETIMING_H_
+
+#include "zc_alleg.h"
+
+// Times the phases of each frame. The last FRAME_TIMING_FRAMES frames are
+// kept, shown as an overlay and written out as a Chrome trace (load it at
+// chrome://tracing) when timing is stopped.
+
+#define FRAME_TIMING_FRAMES 600
+
+enum
+{
+    fpGLOBALSCRIPT, fpFFCSCRIPTS, fpCOMBOS, fpGUYS, fpWEAPONS, fpLINK,
+    fpDRAWSCREEN, fpPRIMITIVES, fpSUBSCREEN, fpUPDATESCR, fpTHROTTLE, fpMAX
+};
+
+extern bool frame_timing;
+
+void start_frame_timing();
+void stop_frame_timing(const char *filename = "frame_timing.json");
+
+unsigned long long frame_timing_clock();
+void add_frame_phase(int phase, unsigned long long start);
+
+// Ends the current frame's sample. Called once per frame by advanceframe().
+void next_frame_timing();
+
+// Draws the average and worst time of each phase over the last second.
+void show_frame_timing(BITMAP *target);
+
+// Times the rest of the enclosing scope as the given phase.
+class frame_phase_timer
+{
+public:
+    frame_phase_timer(int phase) : phase(phase), start(frame_timing ? frame_timing_clock() : 0) {}
+    ~frame_phase_timer()
+    {
+        if(start)
+            add_frame_phase(phase, start);
+    }
+    
+private:
+    int phase;
+    unsigned long long start;
+};
+
+#endif
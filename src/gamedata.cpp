@@ -12,6 +12,7 @@
 #include "precompiled.h" //always first
 
 #include <stdio.h>
+#include <algorithm>
 #include "zc_alleg.h"
 #include "zdefs.h"
 #include "zelda.h"
@@ -31,6 +32,144 @@ extern void ringcolor(bool forceDefault);
 // #define DEBUG_GD_COUNTERS
 //#define DEBUG_GD_HCP
 
+/**** screen_d_map ****/
+
+#define SCREEN_D_EMPTY 0xFFFFFFFF
+
+static inline dword screen_d_key(dword screen, int index)
+{
+    return (screen<<3)+index;
+}
+
+static inline dword screen_d_hash(dword key, dword mask)
+{
+    return (key*2654435761u)&mask;
+}
+
+long screen_d_map::get(dword screen, int index) const
+{
+    if(!count || screen>=MAXDMAPS*MAPSCRSNORMAL || index<0 || index>7)
+        return 0;
+        
+    dword key=screen_d_key(screen, index);
+    dword mask=slots.size()-1;
+    
+    for(dword i=screen_d_hash(key, mask);; i=(i+1)&mask)
+    {
+        if(slots[i].key==key)
+            return slots[i].value;
+            
+        if(slots[i].key==SCREEN_D_EMPTY)
+            return 0;
+    }
+}
+
+void screen_d_map::set(dword screen, int index, long value)
+{
+    if(screen>=MAXDMAPS*MAPSCRSNORMAL || index<0 || index>7)
+        return;
+        
+    if(slots.empty())
+    {
+        if(!value)
+            return;
+            
+        rehash(64);
+    }
+    
+    dword key=screen_d_key(screen, index);
+    dword mask=slots.size()-1;
+    dword i=screen_d_hash(key, mask);
+    
+    while(slots[i].key!=key && slots[i].key!=SCREEN_D_EMPTY)
+        i=(i+1)&mask;
+        
+    if(slots[i].key==key)
+    {
+        if(value)
+        {
+            slots[i].value=value;
+            return;
+        }
+        
+        // Remove it, shifting back any entries that probed past it.
+        dword hole=i;
+        
+        for(dword j=(i+1)&mask; slots[j].key!=SCREEN_D_EMPTY; j=(j+1)&mask)
+        {
+            dword home=screen_d_hash(slots[j].key, mask);
+            
+            if(((j-home)&mask) >= ((j-hole)&mask))
+            {
+                slots[hole]=slots[j];
+                hole=j;
+            }
+        }
+        
+        slots[hole].key=SCREEN_D_EMPTY;
+        --count;
+        return;
+    }
+    
+    if(!value)
+        return;
+        
+    slots[i].key=key;
+    slots[i].value=value;
+    
+    if(++count*4 > slots.size()*3)
+        rehash(slots.size()*2);
+}
+
+void screen_d_map::clear()
+{
+    slots.clear();
+    count=0;
+}
+
+static bool screen_d_entry_less(const screen_d_map::entry &a, const screen_d_map::entry &b)
+{
+    return a.key<b.key;
+}
+
+void screen_d_map::get_entries(std::vector<entry> &out) const
+{
+    out.clear();
+    out.reserve(count);
+    
+    for(dword i=0; i<slots.size(); ++i)
+    {
+        if(slots[i].key!=SCREEN_D_EMPTY)
+            out.push_back(slots[i]);
+    }
+    
+    std::sort(out.begin(), out.end(), screen_d_entry_less);
+}
+
+void screen_d_map::rehash(dword newsize)
+{
+    std::vector<entry> old;
+    old.swap(slots);
+    entry empty={SCREEN_D_EMPTY, 0};
+    slots.assign(newsize, empty);
+    dword mask=newsize-1;
+    
+    for(dword i=0; i<old.size(); ++i)
+    {
+        if(old[i].key==SCREEN_D_EMPTY)
+            continue;
+            
+        dword j=screen_d_hash(old[i].key, mask);
+        
+        while(slots[j].key!=SCREEN_D_EMPTY)
+            j=(j+1)&mask;
+            
+        slots[j]=old[i];
+    }
+}
+
+/**** gamedata ****/
+
 void gamedata::Clear()
 {
     isclearing=true;
@@ -61,7 +200,7 @@ void gamedata::Clear()
     std::fill(icon, icon+128, 0);
     std::fill(pal, pal+48, 0);
     
-    for(int i=0; i<MAXDMAPS*MAPSCRSNORMAL; i++) std::fill(screen_d[i], screen_d[i]+8, 0);
+    screen_d.clear();
     
     std::fill(global_d, global_d+256, 0);
     globalRAM.clear();
@@ -135,9 +274,7 @@ void gamedata::Copy(const gamedata& g)
     for(byte i = 0; i < 48; i++)
         pal[i] = g.pal[i];
         
-    for(dword i = 0; i < MAXDMAPS*MAPSCRSNORMAL; i++)
-        for(byte j = 0; j < 8; j++)
-            screen_d[i][j] = g.screen_d[i][j];
+    screen_d = g.screen_d;
             
     for(word i = 0; i < 256; i++)
         global_d[i] = g.global_d[i];
@@ -12,6 +12,8 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <algorithm>
+#include <vector>
 #include "zc_alleg.h"
 #include "guys.h"
 #include "zelda.h"
@@ -13944,7 +13946,7 @@ bool parsemsgcode()
         int s = ((get_currdmap())<<7) + get_currscr()-(DMaps[get_currdmap()].type==dmOVERW ? 0 : DMaps[get_currdmap()].xoff);
         arg = (int)grab_next_argument();
         
-        if(game->screen_d[s][d] >= arg)
+        if(game->screen_d.get(s, d) >= arg)
             goto switched;
             
         (void)grab_next_argument();
@@ -14435,17 +14437,131 @@ void clear_script_one_frame_conditions()
 	}
 }
 		
+// Broad phase for check_collisions(). Enemies are bucketed by the cells
+// their hitboxes overlap, so each weapon only tests the enemies near it.
+// Anything off the grid is clamped into its border cells.
+#define COLGRID_SHIFT 5 //32x32 cells
+#define COLGRID_X0 (-64)
+#define COLGRID_Y0 (-64)
+#define COLGRID_W 12
+#define COLGRID_H 10
+
+static std::vector<int> colgrid[COLGRID_W*COLGRID_H];
+static int colgrid_count = -1; //number of enemies in the grid, -1 if it needs rebuilding
+static int colgrid_stamp[SLMAX];
+static int colgrid_clock = 0;
+
+static void colgrid_cells(sprite *s, int hysz, int &x1, int &y1, int &x2, int &y2)
+{
+    // Pad by a pixel or two for the rounding in sprite::hit().
+    int l = int(s->x)+s->hxofs-2;
+    int t = int(s->y)+s->hyofs-2;
+    int r = l+zc_max(s->hxsz,0)+4;
+    int b = t+zc_max(hysz,0)+4;
+    x1 = vbound((l-COLGRID_X0)>>COLGRID_SHIFT, 0, COLGRID_W-1);
+    y1 = vbound((t-COLGRID_Y0)>>COLGRID_SHIFT, 0, COLGRID_H-1);
+    x2 = vbound((r-COLGRID_X0)>>COLGRID_SHIFT, 0, COLGRID_W-1);
+    y2 = vbound((b-COLGRID_Y0)>>COLGRID_SHIFT, 0, COLGRID_H-1);
+}
+
+static void build_colgrid()
+{
+    for(int c=0; c<COLGRID_W*COLGRID_H; c++)
+        colgrid[c].clear();
+        
+    colgrid_count = guys.Count();
+    
+    for(int j=0; j<colgrid_count; j++)
+    {
+        enemy *e = (enemy*)guys.spr(j);
+        int hysz = e->hysz;
+        
+        // eAquamentus::hit() stretches its hitbox to 32 high for some weapons.
+        if(e->family==eeAQUA)
+            hysz = zc_max(hysz, 32);
+            
+        int x1, y1, x2, y2;
+        colgrid_cells(e, hysz, x1, y1, x2, y2);
+        
+        for(int cy=y1; cy<=y2; cy++)
+            for(int cx=x1; cx<=x2; cx++)
+                colgrid[cy*COLGRID_W+cx].push_back(j);
+    }
+}
+
+// Fills 'out' with the indices of the enemies that might touch s, in
+// ascending order so the hits happen in the same order as a full scan.
+// Enemies added since the grid was built are always included.
+static void colgrid_query(sprite *s, std::vector<int> &out)
+{
+    out.clear();
+    
+    if(++colgrid_clock == 0)
+    {
+        memset(colgrid_stamp, 0, sizeof(colgrid_stamp));
+        colgrid_clock = 1;
+    }
+    
+    int x1, y1, x2, y2;
+    colgrid_cells(s, s->hysz, x1, y1, x2, y2);
+    
+    for(int cy=y1; cy<=y2; cy++)
+    {
+        for(int cx=x1; cx<=x2; cx++)
+        {
+            std::vector<int> &cell = colgrid[cy*COLGRID_W+cx];
+            
+            for(size_t k=0; k<cell.size(); k++)
+            {
+                if(colgrid_stamp[cell[k]] != colgrid_clock)
+                {
+                    colgrid_stamp[cell[k]] = colgrid_clock;
+                    out.push_back(cell[k]);
+                }
+            }
+        }
+    }
+    
+    std::sort(out.begin(), out.end());
+    
+    for(int j=colgrid_count; j<guys.Count(); j++)
+        out.push_back(j);
+}
+
 void check_collisions()
 {
     bool temp_hit = false;
+    int cleared = 0; //enemies [0, cleared) have already had HitBy[] cleared this frame
+    static std::vector<int> nearby;
+    colgrid_count = -1;
+    
     for(int i=0; i<Lwpns.Count(); i++)
     {
         weapon *w = (weapon*)Lwpns.spr(i);
         
         if(!(w->Dead()) && w->id!=wSword && w->id!=wHammer && w->id!=wWand)
         {
-            for(int j=0; j<guys.Count(); j++)
+            // Until something has been hit, every enemy has to be visited
+            // once to clear its HitBy[] entry. After that only nearby
+            // enemies can be affected.
+            bool broadphase = temp_hit || cleared == guys.Count();
+            bool struck = false;
+            
+            if(broadphase)
             {
+                if(colgrid_count < 0 || colgrid_count > guys.Count())
+                    build_colgrid();
+                    
+                colgrid_query(w, nearby);
+            }
+            
+            for(int n=0; n < (broadphase ? (int)nearby.size() : guys.Count()); n++)
+            {
+                int j = broadphase ? nearby[n] : n;
+                
+                if(j >= guys.Count())
+                    break;
+                    
                 enemy *e = (enemy*)guys.spr(j);
 		if ( !temp_hit ) e->hitby[HIT_BY_LWEAPON] = 0;
                 
@@ -14453,6 +14569,10 @@ void check_collisions()
 				//because this only checks `if(dying || clk<0 || hclk>0 || superman)`
                 {//!(e->stunclk)
                     int h = e->takehit(w);
+                    colgrid_count = -1; //the enemy may have moved or spawned others
+                    cleared = 0;
+                    struck = true;
+                    
                      if (h == -1) 
 		    { 
 			    e->hitby[HIT_BY_LWEAPON] = i+1; temp_hit = true; 
@@ -14512,6 +14632,15 @@ void check_collisions()
                     {
                         break;
                     }
+                    
+                    if(broadphase)
+                    {
+                        // Look again from the next enemy on, with the grid
+                        // rebuilt for whatever the hit changed.
+                        build_colgrid();
+                        colgrid_query(w, nearby);
+                        n = int(std::upper_bound(nearby.begin(), nearby.end(), j) - nearby.begin()) - 1;
+                    }
                 }
                 
                 if(w->Dead())
@@ -14519,6 +14648,11 @@ void check_collisions()
                     break;
                 }
             }
+            
+            if(!broadphase && !struck && !temp_hit)
+            {
+                cleared = guys.Count();
+            }
 	
 		// Item flags added in 2.55:
 		// BRang/HShot/Arrows ITEM_FLAG4 is "Pick up anything" (port of qr_BRANGPICKUP)
@@ -14545,6 +14679,8 @@ void check_collisions()
 							}
 							
 							Link.checkitems(j);
+							colgrid_count = -1; //scripts may move enemies around
+							cleared = 0;
 						}
 					}
 				}
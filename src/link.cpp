@@ -15919,15 +15919,7 @@ void LinkClass::gameover()
 					if(f==60)
 					{
 						red_shift();
-						create_rgb_table_range(&rgb_table, RAMpal, 208, 239, NULL);
-						create_zc_trans_table(&trans_table, RAMpal, 128, 128, 128);
-						memcpy(&trans_table2, &trans_table, sizeof(COLOR_MAP));
-                        
-						for(int q=0; q<PAL_SIZE; q++)
-						{
-							trans_table2.data[0][q] = q;
-							trans_table2.data[q][q] = q;
-						}
+						refresh_palette_tables(208, 239);
 					}
                     
 					if(f>=60 && f<=169)
@@ -15942,15 +15934,7 @@ void LinkClass::gameover()
 					if(f>=139 && f<=169)//fade from red to black
 					{
 						fade_interpolate(RAMpal,black_palette,RAMpal, (f-138)<<1, 224, 255);
-						create_rgb_table_range(&rgb_table, RAMpal, 208, 239, NULL);
-						create_zc_trans_table(&trans_table, RAMpal, 128, 128, 128);
-						memcpy(&trans_table2, &trans_table, sizeof(COLOR_MAP));
-                        
-						for(int q=0; q<PAL_SIZE; q++)
-						{
-							trans_table2.data[0][q] = q;
-							trans_table2.data[q][q] = q;
-						}
+						refresh_palette_tables(208, 239);
                         
 						refreshpal=true;
 					}
@@ -34,6 +34,7 @@
 #include "guys.h"
 #include "ffscript.h"
 #include "particles.h"
+#include "frametiming.h"
 #include "mem_debug.h"
 
 
@@ -124,6 +125,8 @@ void debugging_box(int x1, int y1, int x2, int y2)
     sdci[10] = 0;
     sdci[11] = 10000;
     sdci[12] = 1280000;
+    
+    script_drawing_commands.Submit(index);
 }
 
 void clear_dmap(word i)
@@ -533,6 +536,7 @@ void update_combo_cycling()
     static int newcset2[176];
     static bool restartanim[MAXCOMBOS];
     static bool restartanim2[MAXCOMBOS];
+    static std::vector<int> restarted;
     static bool initialized=false;
     
     // Just a simple bit of optimization
@@ -551,6 +555,20 @@ void update_combo_cycling()
         initialized=true;
     }
     
+    // Nothing can cycle unless one of the animations is due this frame.
+    bool due=false;
+    const std::vector<word> &due1=combo_animations_due(false);
+    const std::vector<word> &due2=combo_animations_due(true);
+    
+    for(size_t i=0; i<due1.size() && !due; i++)
+        due=combobuf[due1[i]].nextcombo!=0;
+        
+    for(size_t i=0; i<due2.size() && !due; i++)
+        due=combobuf[due2[i]].nextcombo!=0;
+        
+    if(!due)
+        return;
+        
     for(int i=0; i<176; i++)
     {
         x=tmpscr->data[i];
@@ -559,7 +577,7 @@ void update_combo_cycling()
         if(combobuf[x].animflags & AF_FRESH) continue;
         
         //time to restart
-        if((animated_combo_table4[y][1]>=combobuf[x].speed) &&
+        if((combo_animation_clock(y)>=combobuf[x].speed) &&
                 (combobuf[x].tile-combobuf[x].frames>=animated_combo_table[x][1]-1) &&
                 (combobuf[x].nextcombo!=0))
         {
@@ -567,9 +585,10 @@ void update_combo_cycling()
             newcset[i]=combobuf[x].nextcset;
             int c=newdata[i];
             
-            if(combobuf[c].animflags & AF_CYCLE)
+            if((combobuf[c].animflags & AF_CYCLE) && !restartanim[c])
             {
                 restartanim[c]=true;
+                restarted.push_back(c);
             }
         }
     }
@@ -582,7 +601,7 @@ void update_combo_cycling()
         if(!(combobuf[x].animflags & AF_FRESH)) continue;
         
         //time to restart
-        if((animated_combo_table24[y][1]>=combobuf[x].speed) &&
+        if((combo_animation_clock2(y)>=combobuf[x].speed) &&
                 (combobuf[x].tile-combobuf[x].frames>=animated_combo_table2[x][1]-1) &&
                 (combobuf[x].nextcombo!=0))
         {
@@ -590,9 +609,10 @@ void update_combo_cycling()
             newcset[i]=combobuf[x].nextcset;
             int c=newdata[i];
             
-            if(combobuf[c].animflags & AF_CYCLE)
+            if((combobuf[c].animflags & AF_CYCLE) && !restartanim2[c])
             {
                 restartanim2[c]=true;
+                restarted.push_back(c);
             }
         }
     }
@@ -619,7 +639,7 @@ void update_combo_cycling()
         if(combobuf[x].animflags & AF_FRESH) continue;
         
         //time to restart
-        if((animated_combo_table4[y][1]>=combobuf[x].speed) &&
+        if((combo_animation_clock(y)>=combobuf[x].speed) &&
                 (combobuf[x].tile-combobuf[x].frames>=animated_combo_table[x][1]-1) &&
                 (combobuf[x].nextcombo!=0))
         {
@@ -627,9 +647,10 @@ void update_combo_cycling()
             newcset[i]=combobuf[x].nextcset;
             int c=newdata[i];
             
-            if(combobuf[c].animflags & AF_CYCLE)
+            if((combobuf[c].animflags & AF_CYCLE) && !restartanim[c])
             {
                 restartanim[c]=true;
+                restarted.push_back(c);
             }
         }
     }
@@ -642,7 +663,7 @@ void update_combo_cycling()
         if(!(combobuf[x].animflags & AF_FRESH)) continue;
         
         //time to restart
-        if((animated_combo_table24[y][1]>=combobuf[x].speed) &&
+        if((combo_animation_clock2(y)>=combobuf[x].speed) &&
                 (combobuf[x].tile-combobuf[x].frames>=animated_combo_table2[x][1]-1) &&
                 (combobuf[x].nextcombo!=0))
         {
@@ -650,9 +671,10 @@ void update_combo_cycling()
             newcset[i]=combobuf[x].nextcset;
             int c=newdata[i];
             
-            if(combobuf[c].animflags & AF_CYCLE)
+            if((combobuf[c].animflags & AF_CYCLE) && !restartanim2[c])
             {
                 restartanim2[c]=true;
+                restarted.push_back(c);
             }
         }
     }
@@ -683,7 +705,7 @@ void update_combo_cycling()
                 if(combobuf[x].animflags & AF_FRESH) continue;
                 
                 //time to restart
-                if((animated_combo_table4[y][1]>=combobuf[x].speed) &&
+                if((combo_animation_clock(y)>=combobuf[x].speed) &&
                         (combobuf[x].tile-combobuf[x].frames>=animated_combo_table[x][1]-1) &&
                         (combobuf[x].nextcombo!=0))
                 {
@@ -691,9 +713,10 @@ void update_combo_cycling()
                     newcset[i]=combobuf[x].nextcset;
                     int c=newdata[i];
                     
-                    if(combobuf[c].animflags & AF_CYCLE)
+                    if((combobuf[c].animflags & AF_CYCLE) && !restartanim[c])
                     {
                         restartanim[c]=true;
+                        restarted.push_back(c);
                     }
                 }
             }
@@ -706,7 +729,7 @@ void update_combo_cycling()
                 if(!(combobuf[x].animflags & AF_FRESH)) continue;
                 
                 //time to restart
-                if((animated_combo_table24[y][1]>=combobuf[x].speed) &&
+                if((combo_animation_clock2(y)>=combobuf[x].speed) &&
                         (combobuf[x].tile-combobuf[x].frames>=animated_combo_table2[x][1]-1) &&
                         (combobuf[x].nextcombo!=0))
                 {
@@ -715,9 +738,10 @@ void update_combo_cycling()
                     int c=newdata2[i];
                     int cs=newcset2[i];
                     
-                    if(combobuf[c].animflags & AF_CYCLE)
+                    if((combobuf[c].animflags & AF_CYCLE) && !restartanim2[c])
                     {
                         restartanim2[c]=true;
+                        restarted.push_back(c);
                     }
                     
                     if(combobuf[c].type==cSPINTILE1)
@@ -752,22 +776,26 @@ void update_combo_cycling()
         }
     }
     
-    for(int i=0; i<MAXCOMBOS; i++)
+    for(size_t j=0; j<restarted.size(); j++)
     {
+        int i=restarted[j];
+        
         if(restartanim[i])
         {
             combobuf[i].tile = animated_combo_table[i][1];
-            animated_combo_table4[animated_combo_table[i][0]][1]=0;
+            reset_combo_animation_clock(animated_combo_table[i][0]);
             restartanim[i]=false;
         }
         
         if(restartanim2[i])
         {
             combobuf[i].tile = animated_combo_table2[i][1];
-            animated_combo_table4[animated_combo_table[i][0]][1]=0;
+            reset_combo_animation_clock(animated_combo_table[i][0]);
             restartanim2[i]=false;
         }
     }
+    
+    restarted.clear();
 }
 
 bool iswater_type(int type)
@@ -2221,17 +2249,11 @@ void do_scrolling_layer(BITMAP *bmp, int type, mapscr* layer, int x, int y, bool
                     {
                         if(tempscreen==2)
                         {
-                            for(int i=0; i<176; i++)
-                            {
-                                overcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                            }
+                            overcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                         }
                         else
                         {
-                            for(int i=0; i<176; i++)
-                            {
-                                overcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                            }
+                            overcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                         }
                     }
                     else
@@ -2258,17 +2280,11 @@ void do_scrolling_layer(BITMAP *bmp, int type, mapscr* layer, int x, int y, bool
                     {
                         if(tempscreen==2)
                         {
-                            for(int i=0; i<176; i++)
-                            {
-                                overcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                            }
+                            overcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                         }
                         else
                         {
-                            for(int i=0; i<176; i++)
-                            {
-                                overcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                            }
+                            overcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                         }
                     }
                     else
@@ -2307,34 +2323,22 @@ void do_scrolling_layer(BITMAP *bmp, int type, mapscr* layer, int x, int y, bool
                         {
                             if(tempscreen==2)
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                             }
                             else
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                             }
                         }
                         else
                         {
                             if(tempscreen==2)
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    overcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                                }
+                                overcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                             }
                             else
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    overcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                                }
+                                overcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                             }
                         }
                     }
@@ -2344,17 +2348,11 @@ void do_scrolling_layer(BITMAP *bmp, int type, mapscr* layer, int x, int y, bool
                         {
                             if(tempscreen==2)
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                             }
                             else
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                             }
                         }
                         else
@@ -2384,34 +2382,22 @@ void do_scrolling_layer(BITMAP *bmp, int type, mapscr* layer, int x, int y, bool
                         {
                             if(tempscreen==2)
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                             }
                             else
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                             }
                         }
                         else
                         {
                             if(tempscreen==2)
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    overcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                                }
+                                overcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                             }
                             else
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    overcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                                }
+                                overcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                             }
                         }
                     }
@@ -2421,17 +2407,11 @@ void do_scrolling_layer(BITMAP *bmp, int type, mapscr* layer, int x, int y, bool
                         {
                             if(tempscreen==2)
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                             }
                             else
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                             }
                         }
                         else
@@ -2471,34 +2451,22 @@ void do_scrolling_layer(BITMAP *bmp, int type, mapscr* layer, int x, int y, bool
                         {
                             if(tempscreen==2)
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                             }
                             else
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                             }
                         }
                         else
                         {
                             if(tempscreen==2)
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    overcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                                }
+                                overcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                             }
                             else
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    overcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                                }
+                                overcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                             }
                         }
                     }
@@ -2508,17 +2476,11 @@ void do_scrolling_layer(BITMAP *bmp, int type, mapscr* layer, int x, int y, bool
                         {
                             if(tempscreen==2)
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                             }
                             else
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                             }
                         }
                         else
@@ -2548,34 +2510,22 @@ void do_scrolling_layer(BITMAP *bmp, int type, mapscr* layer, int x, int y, bool
                         {
                             if(tempscreen==2)
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                             }
                             else
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                             }
                         }
                         else
                         {
                             if(tempscreen==2)
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    overcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                                }
+                                overcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                             }
                             else
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    overcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                                }
+                                overcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                             }
                         }
                     }
@@ -2585,17 +2535,11 @@ void do_scrolling_layer(BITMAP *bmp, int type, mapscr* layer, int x, int y, bool
                         {
                             if(tempscreen==2)
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr2[type].data[i],tmpscr2[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr2[type].data,tmpscr2[type].cset);
                             }
                             else
                             {
-                                for(int i=0; i<176; i++)
-                                {
-                                    putcombo(bmp,((i&15)<<4)-x,(i&0xF0)+playing_field_offset-y,tmpscr3[type].data[i],tmpscr3[type].cset[i]);
-                                }
+                                putcombo_grid(bmp,-x,playing_field_offset-y,tmpscr3[type].data,tmpscr3[type].cset);
                             }
                         }
                         else
@@ -2839,7 +2783,6 @@ void draw_screen(mapscr* this_screen, bool showlink)
     set_clip_rect(temp_buf,draw_screen_clip_rect_x1,draw_screen_clip_rect_y1,draw_screen_clip_rect_x2,draw_screen_clip_rect_y2);
     
     int cmby2=0;
-    int pcounter;
     
     //0: Sideview Grvity from DMaps.
     
@@ -2855,26 +2798,14 @@ void draw_screen(mapscr* this_screen, bool showlink)
     {
         do_layer(scrollbuf,1, this_screen, 0, 0, 2, false, true);
         
-        for(pcounter=0; pcounter<particles.Count(); pcounter++)
-        {
-            if(((particle*)particles.spr(pcounter))->layer==1)
-            {
-                particles.spr(pcounter)->draw(scrollbuf);
-            }
-        }
+        draw_particles(scrollbuf, 1);
     }
     
     if(this_screen->flags7&fLAYER3BG || DMaps[currdmap].flags&dmfLAYER3BG)
     {
         do_layer(scrollbuf,2, this_screen, 0, 0, 2, false, true);
         
-        for(pcounter=0; pcounter<particles.Count(); pcounter++)
-        {
-            if(((particle*)particles.spr(pcounter))->layer==2)
-            {
-                particles.spr(pcounter)->draw(scrollbuf);
-            }
-        }
+        draw_particles(scrollbuf, 2);
     }
     
     putscr(scrollbuf,0,playing_field_offset,this_screen);
@@ -2888,13 +2819,7 @@ void draw_screen(mapscr* this_screen, bool showlink)
     if(show_layer_0)
         do_primitives(scrollbuf, 0, this_screen, 0, playing_field_offset);
         
-    for(pcounter=0; pcounter<particles.Count(); pcounter++)
-    {
-        if(((particle*)particles.spr(pcounter))->layer==-3)
-        {
-            particles.spr(pcounter)->draw(scrollbuf);
-        }
-    }
+    draw_particles(scrollbuf, -3);
     
     set_clip_rect(scrollbuf,draw_screen_clip_rect_x1,draw_screen_clip_rect_y1,draw_screen_clip_rect_x2,draw_screen_clip_rect_y2);
     
@@ -2931,13 +2856,7 @@ void draw_screen(mapscr* this_screen, bool showlink)
     
     do_layer(scrollbuf,0, this_screen, 0, 0, 2, false, true); // LAYER 1
     
-    for(pcounter=0; pcounter<particles.Count(); pcounter++)
-    {
-        if(((particle*)particles.spr(pcounter))->layer==0)
-        {
-            particles.spr(pcounter)->draw(scrollbuf);
-        }
-    }
+    draw_particles(scrollbuf, 0);
     
     do_layer(scrollbuf,-3, this_screen, 0, 0, 2); // freeform combos!
     
@@ -2945,13 +2864,7 @@ void draw_screen(mapscr* this_screen, bool showlink)
     {
         do_layer(scrollbuf,1, this_screen, 0, 0, 2, false, true); // LAYER 2
         
-        for(pcounter=0; pcounter<particles.Count(); pcounter++)
-        {
-            if(((particle*)particles.spr(pcounter))->layer==1)
-            {
-                particles.spr(pcounter)->draw(scrollbuf);
-            }
-        }
+        draw_particles(scrollbuf, 1);
     }
     
     if(get_bit(quest_rules,qr_LAYER12UNDERCAVE))
@@ -3169,37 +3082,19 @@ void draw_screen(mapscr* this_screen, bool showlink)
         do_layer(temp_buf,2, this_screen, 0, 0, 2, false, true);
         do_layer(scrollbuf, 2, this_screen, 0, 0, 2);
         
-        for(pcounter=0; pcounter<particles.Count(); pcounter++)
-        {
-            if(((particle*)particles.spr(pcounter))->layer==2)
-            {
-                particles.spr(pcounter)->draw(temp_buf);
-            }
-        }
+        draw_particles(temp_buf, 2);
     }
     
     do_layer(temp_buf,3, this_screen, 0, 0, 2, false, true);
     do_layer(scrollbuf, 3, this_screen, 0, 0, 2);
     //do_primitives(temp_buf, 3, this_screen, 0,playing_field_offset);//don't uncomment me
     
-    for(pcounter=0; pcounter<particles.Count(); pcounter++)
-    {
-        if(((particle*)particles.spr(pcounter))->layer==3)
-        {
-            particles.spr(pcounter)->draw(temp_buf);
-        }
-    }
+    draw_particles(temp_buf, 3);
     
     do_layer(temp_buf,-1, this_screen, 0, 0, 2);
     do_layer(scrollbuf,-1, this_screen, 0, 0, 2);
     
-    for(pcounter=0; pcounter<particles.Count(); pcounter++)
-    {
-        if(((particle*)particles.spr(pcounter))->layer==-1)
-        {
-            particles.spr(pcounter)->draw(temp_buf);
-        }
-    }
+    draw_particles(temp_buf, -1);
     
     //6. Blit temp_buf onto framebuf with clipping
     
@@ -3210,6 +3105,7 @@ void draw_screen(mapscr* this_screen, bool showlink)
     if(!get_bit(quest_rules,qr_SUBSCREENOVERSPRITES))
     {
         set_clip_rect(framebuf,draw_screen_clip_rect_x1,draw_screen_clip_rect_y1,draw_screen_clip_rect_x2,draw_screen_clip_rect_y2);
+        frame_phase_timer timer(fpSUBSCREEN);
         put_passive_subscr(framebuf, &QMisc, 0, passive_subscreen_offset, false, sspUP);
     }
     
@@ -3269,13 +3165,7 @@ void draw_screen(mapscr* this_screen, bool showlink)
     do_layer(temp_buf,4, this_screen, 0, 0, 2, false, true);
     do_layer(scrollbuf, 4, this_screen, 0, 0, 2);
     
-    for(pcounter=0; pcounter<particles.Count(); pcounter++)
-    {
-        if(((particle*)particles.spr(pcounter))->layer==4)
-        {
-            particles.spr(pcounter)->draw(temp_buf);
-        }
-    }
+    draw_particles(temp_buf, 4);
     
     do_layer(temp_buf,-4, this_screen, 0, 0, 2); // overhead freeform combos!
     do_layer(scrollbuf, -4, this_screen, 0, 0, 2);
@@ -3283,13 +3173,7 @@ void draw_screen(mapscr* this_screen, bool showlink)
     do_layer(temp_buf,5, this_screen, 0, 0, 2, false, true);
     do_layer(scrollbuf, 5, this_screen, 0, 0, 2);
     
-    for(pcounter=0; pcounter<particles.Count(); pcounter++)
-    {
-        if(((particle*)particles.spr(pcounter))->layer==5)
-        {
-            particles.spr(pcounter)->draw(temp_buf);
-        }
-    }
+    draw_particles(temp_buf, 5);
     
     //10. Blit temp_buf onto framebuf with clipping
     
@@ -3312,7 +3196,10 @@ void draw_screen(mapscr* this_screen, bool showlink)
     
     if(get_bit(quest_rules,qr_SUBSCREENOVERSPRITES))
     {
-        put_passive_subscr(framebuf, &QMisc, 0, passive_subscreen_offset, false, sspUP);
+        {
+            frame_phase_timer timer(fpSUBSCREEN);
+            put_passive_subscr(framebuf, &QMisc, 0, passive_subscreen_offset, false, sspUP);
+        }
         
         // Draw primitives over subscren
         do_primitives(framebuf, 7, this_screen, 0, playing_field_offset); //Layer '7' appears above subscreen if quest rule is set
@@ -3811,7 +3698,7 @@ void loadscr(int tmp,int destdmap, int scr,int ldir,bool overlay=false)
     {
         if(combobuf[animated_combo_table4[x][0]].nextcombo!=0)
         {
-            animated_combo_table4[x][1]=0;
+            reset_combo_animation_clock(x);
         }
     }
     
@@ -3819,7 +3706,7 @@ void loadscr(int tmp,int destdmap, int scr,int ldir,bool overlay=false)
     {
         if(combobuf[animated_combo_table24[x][0]].nextcombo!=0)
         {
-            animated_combo_table24[x][1]=0;
+            reset_combo_animation_clock2(x);
         }
     }
     
@@ -4109,6 +3996,11 @@ void loadscr(int tmp,int destdmap, int scr,int ldir,bool overlay=false)
             }
         }
     }
+    
+    if(tmp==0)
+    {
+        build_walkflags();
+    }
 }
 
 // Screen is being viewed by the Overworld Map viewer.
@@ -4118,7 +4010,7 @@ void loadscr2(int tmp,int scr,int)
     {
         if(combobuf[animated_combo_table4[x][0]].nextcombo!=0)
         {
-            animated_combo_table4[x][1]=0;
+            reset_combo_animation_clock(x);
         }
     }
     
@@ -4331,6 +4223,78 @@ void putscrdoors(BITMAP *dest,int x,int y, mapscr* scrn)
     }
 }
 
+// Walkability of tmpscr and its first two layers, combined per combo
+// position. Each cell remembers the combos it was built from, so changes
+// to the screens are picked up the next time the cell is looked at;
+// changes to the combos themselves go through combo_walkflags_changed().
+struct walkflag_cell
+{
+    dword gen;
+    word combo[3];
+    byte solid;     // walk bits set on any layer
+    byte dry_solid; // walk bits set on any non-water layer
+    byte dry_first; // walk bits whose lowest layer setting them isn't water
+    bool water;     // any layer is water
+};
+
+static walkflag_cell walkflag_cells[176];
+static dword walkflag_gen=1;
+
+void combo_walkflags_changed()
+{
+    ++walkflag_gen;
+}
+
+static void build_walkflag_cell(walkflag_cell &w, word c0, word c1, word c2)
+{
+    w.gen=walkflag_gen;
+    w.combo[0]=c0;
+    w.combo[1]=c1;
+    w.combo[2]=c2;
+    w.solid=w.dry_solid=w.dry_first=0;
+    w.water=false;
+    
+    for(int i=0; i<3; ++i)
+    {
+        const newcombo &c=combobuf[w.combo[i]];
+        bool water=iswater_type(c.type);
+        
+        if(!water)
+        {
+            w.dry_solid|=c.walk;
+            w.dry_first|=c.walk&~w.solid;
+        }
+        
+        w.solid|=c.walk;
+        w.water|=water;
+    }
+}
+
+static inline const walkflag_cell &walkflag_at(int bx)
+{
+    const mapscr *s1=(((*tmpscr).layermap[0]-1)>=0)?tmpscr2:tmpscr;
+    const mapscr *s2=(((*tmpscr).layermap[1]-1)>=0)?tmpscr2+1:tmpscr;
+    walkflag_cell &w=walkflag_cells[bx];
+    word c0=tmpscr->data[bx], c1=s1->data[bx], c2=s2->data[bx];
+    
+    if(w.gen!=walkflag_gen || w.combo[0]!=c0 || w.combo[1]!=c1 || w.combo[2]!=c2)
+    {
+        build_walkflag_cell(w, c0, c1, c2);
+    }
+    
+    return w;
+}
+
+void build_walkflags()
+{
+    ++walkflag_gen;
+    
+    for(int i=0; i<176; ++i)
+    {
+        walkflag_at(i);
+    }
+}
+
 bool _walkflag(int x,int y,int cnt)
 {
     //  walkflagx=x; walkflagy=y;
@@ -4355,24 +4319,16 @@ bool _walkflag(int x,int y,int cnt)
         if(y>168) return false;
     }
     
-    mapscr *s1, *s2;
-    s1=(((*tmpscr).layermap[0]-1)>=0)?tmpscr2:tmpscr;
-    s2=(((*tmpscr).layermap[1]-1)>=0)?tmpscr2+1:tmpscr;
-    //  s2=TheMaps+((*tmpscr).layermap[1]-1)MAPSCRS+((*tmpscr).layerscreen[1]);
-    
     int bx=(x>>4)+(y&0xF0);
-    newcombo c = combobuf[tmpscr->data[bx]];
-    newcombo c1 = combobuf[s1->data[bx]];
-    newcombo c2 = combobuf[s2->data[bx]];
-    bool dried = (((iswater_type(c.type)) || (iswater_type(c1.type)) ||
-                   (iswater_type(c2.type))) && DRIEDLAKE);
+    const walkflag_cell *w=&walkflag_at(bx);
+    bool dried = w->water && DRIEDLAKE;
     int b=1;
     
     if(x&8) b<<=2;
     
     if(y&8) b<<=1;
     
-    if(((c.walk&b) || (c1.walk&b) || (c2.walk&b)) && !dried)
+    if((w->solid&b) && !dried)
         return true;
         
     if(cnt==1) return false;
@@ -4383,17 +4339,14 @@ bool _walkflag(int x,int y,int cnt)
         b<<=2;
     else
     {
-        c  = combobuf[tmpscr->data[bx]];
-        c1 = combobuf[s1->data[bx]];
-        c2 = combobuf[s2->data[bx]];
-        dried = (((iswater_type(c.type)) || (iswater_type(c1.type)) ||
-                  (iswater_type(c2.type))) && DRIEDLAKE);
+        w=&walkflag_at(bx);
+        dried = w->water && DRIEDLAKE;
         b=1;
         
         if(y&8) b<<=1;
     }
     
-    return ((c.walk&b)||(c1.walk&b)||(c2.walk&b)) ? !dried : false;
+    return (w->solid&b) ? !dried : false;
 }
 
 bool water_walkflag(int x,int y,int cnt)
@@ -4419,35 +4372,15 @@ bool water_walkflag(int x,int y,int cnt)
         if(y>168) return false;
     }
     
-    mapscr *s1, *s2;
-    /*
-      s1=(((*tmpscr).layermap[0]-1)>=0)?
-      (TheMaps+((*tmpscr).layermap[0]-1)*MAPSCRS+((*tmpscr).layerscreen[0])):
-      tmpscr;
-      s2=(((*tmpscr).layermap[1]-1)>=0)?
-      (TheMaps+((*tmpscr).layermap[1]-1)*MAPSCRS+((*tmpscr).layerscreen[1])):
-      tmpscr;
-      */
-    s1=(((*tmpscr).layermap[0]-1)>=0)?tmpscr2:tmpscr;
-    s2=(((*tmpscr).layermap[1]-1)>=0)?tmpscr2+1:tmpscr;
-    
     int bx=(x>>4)+(y&0xF0);
-    newcombo c = combobuf[tmpscr->data[bx]];
-    newcombo c1 = combobuf[s1->data[bx]];
-    newcombo c2 = combobuf[s2->data[bx]];
+    const walkflag_cell *w=&walkflag_at(bx);
     int b=1;
     
     if(x&8) b<<=2;
     
     if(y&8) b<<=1;
     
-    if((c.walk&b) && !iswater_type(c.type))
-        return true;
-        
-    if((c1.walk&b) && !iswater_type(c1.type))
-        return true;
-        
-    if((c2.walk&b) && !iswater_type(c2.type))
+    if(w->dry_solid&b)
         return true;
         
     if(cnt==1) return false;
@@ -4456,17 +4389,13 @@ bool water_walkflag(int x,int y,int cnt)
         b<<=2;
     else
     {
-        c = combobuf[tmpscr->data[++bx]];
-        c1 = combobuf[s1->data[bx]];
-        c2 = combobuf[s2->data[bx]];
+        w=&walkflag_at(++bx);
         b=1;
         
         if(y&8) b<<=1;
     }
     
-    return (c.walk&b) ? !iswater_type(c.type) :
-           (c1.walk&b) ? !iswater_type(c1.type) :
-           (c2.walk&b) ? !iswater_type(c2.type) :false;
+    return (w->dry_first&b)!=0;
 }
 
 bool hit_walkflag(int x,int y,int cnt)
@@ -94,6 +94,8 @@ void loadscr2(int tmp,int scr,int);
 void loadscr(int tmp,int destdmap,int scr,int ldir,bool overlay);
 void putscr(BITMAP* dest,int x,int y,mapscr* screen);
 void putscrdoors(BITMAP *dest,int x,int y,mapscr* screen);
+void combo_walkflags_changed();
+void build_walkflags();
 bool _walkflag(int x,int y,int cnt);
 bool water_walkflag(int x,int y,int cnt);
 bool hit_walkflag(int x,int y,int cnt);
@@ -19,6 +19,7 @@
 #include "colors.h"
 #include "zsys.h"
 #include "pal.h"
+#include "jwin.h"
 #include "subscr.h"
 
 extern LinkClass Link;
@@ -77,6 +78,116 @@ void copy_pal(RGB *src,RGB *dest)
         dest[i]=src[i];
 }
 
+/**** Palette lookup tables ****/
+
+// rgb_table and trans_table depend only on the palette, and fades and
+// palette cycling keep returning to the same few palettes, so the tables
+// for the last few are kept.
+#define PALTABLE_CACHE_SIZE 4
+
+struct palette_tables
+{
+    bool valid;
+    dword hash, last_used;
+    int first, last;
+    PALETTE pal;
+    RGB_MAP rgb;
+    COLOR_MAP trans;
+};
+
+static palette_tables paltable_cache[PALTABLE_CACHE_SIZE];
+static dword paltable_clock=0;
+
+static dword palette_hash(AL_CONST PALETTE pal, int first, int last)
+{
+    dword h=2166136261u;
+    
+    for(int i=0; i<PAL_SIZE; ++i)
+    {
+        h=(h^pal[i].r)*16777619u;
+        h=(h^pal[i].g)*16777619u;
+        h=(h^pal[i].b)*16777619u;
+    }
+    
+    return (h^(first<<8)^last)*16777619u;
+}
+
+static bool same_palette(AL_CONST PALETTE a, AL_CONST PALETTE b)
+{
+    for(int i=0; i<PAL_SIZE; ++i)
+    {
+        if(a[i].r!=b[i].r || a[i].g!=b[i].g || a[i].b!=b[i].b)
+            return false;
+    }
+    
+    return true;
+}
+
+static void build_palette_tables(RGB_MAP *rgb, COLOR_MAP *trans, int first, int last)
+{
+    if(first==0 && last==PAL_SIZE-1)
+        create_rgb_table(rgb, RAMpal, NULL);
+    else
+        create_rgb_table_range(rgb, RAMpal, first, last, NULL);
+        
+    create_zc_trans_table(trans, RAMpal, 128, 128, 128);
+}
+
+void refresh_palette_tables(int first, int last)
+{
+    // The translucency table is built through rgb_map, so the cache can
+    // only stand in for the usual setup where that's rgb_table.
+    if(rgb_map!=&rgb_table)
+    {
+        build_palette_tables(&rgb_table, &trans_table, first, last);
+    }
+    else
+    {
+        dword hash=palette_hash(RAMpal, first, last);
+        palette_tables *slot=NULL;
+        palette_tables *oldest=&paltable_cache[0];
+        
+        for(int i=0; i<PALTABLE_CACHE_SIZE; ++i)
+        {
+            palette_tables *t=&paltable_cache[i];
+            
+            if(t->valid && t->hash==hash && t->first==first && t->last==last && same_palette(t->pal, RAMpal))
+            {
+                slot=t;
+                break;
+            }
+            
+            if(!t->valid || (oldest->valid && t->last_used<oldest->last_used))
+                oldest=t;
+        }
+        
+        if(!slot)
+        {
+            slot=oldest;
+            rgb_map=&slot->rgb;
+            build_palette_tables(&slot->rgb, &slot->trans, first, last);
+            rgb_map=&rgb_table;
+            memcpy(slot->pal, RAMpal, sizeof(PALETTE));
+            slot->hash=hash;
+            slot->first=first;
+            slot->last=last;
+            slot->valid=true;
+        }
+        
+        slot->last_used=++paltable_clock;
+        memcpy(&rgb_table, &slot->rgb, sizeof(RGB_MAP));
+        memcpy(&trans_table, &slot->trans, sizeof(COLOR_MAP));
+    }
+    
+    memcpy(&trans_table2, &trans_table, sizeof(COLOR_MAP));
+    
+    for(int q=0; q<PAL_SIZE; q++)
+    {
+        trans_table2.data[0][q] = q;
+        trans_table2.data[q][q] = q;
+    }
+}
+
 void loadfullpal()
 {
     for(int i=0; i<240; i++)
@@ -118,15 +229,7 @@ void loadlvlpal(int level)
 	tempgreypal[CSET(6)+2] = NESpal(0x37);
     }
         
-    create_rgb_table(&rgb_table, RAMpal, NULL);
-    create_zc_trans_table(&trans_table, RAMpal, 128, 128, 128);
-    memcpy(&trans_table2, &trans_table, sizeof(COLOR_MAP));
-    
-    for(int q=0; q<PAL_SIZE; q++)
-    {
-        trans_table2.data[0][q] = q;
-        trans_table2.data[q][q] = q;
-    }
+    refresh_palette_tables();
     
     //! We need to store the new palette into the monochrome scratch palette. 
     //memcpy(tempgreypal, RAMpal, PAL_SIZE*sizeof(RGB));
@@ -426,15 +529,7 @@ int level = (Link.getSpecialCave()>0) ? (Link.getSpecialCave()>=GUYCAVE) ? 10 :
         if(!get_bit(quest_rules,qr_NOLEVEL3FIX) && level==3)
             RAMpal[CSET(6)+2] = NESpal(0x37);
             
-        create_rgb_table(&rgb_table, RAMpal, NULL);
-        create_zc_trans_table(&trans_table, RAMpal, 128, 128, 128);
-        memcpy(&trans_table2, &trans_table, sizeof(COLOR_MAP));
-        
-        for(int q=0; q<PAL_SIZE; q++)
-        {
-            trans_table2.data[0][q] = q;
-            trans_table2.data[q][q] = q;
-        }
+        refresh_palette_tables();
         
         darkroom = newstate;
     }
@@ -26,6 +26,7 @@ extern RGB _RGB(int r,int g,int b);
 extern RGB invRGB(RGB s);
 extern RGB mixRGB(int r1,int g1,int b1,int r2,int g2,int b2,int ratio);
 
+extern void refresh_palette_tables(int first=0, int last=PAL_SIZE-1);
 extern void copy_pal(RGB *src,RGB *dest);
 extern void loadfullpal();
 extern void loadlvlpal(int level);
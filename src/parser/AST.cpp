@@ -506,18 +506,20 @@ ASTDataDeclList::ASTDataDeclList(ASTDataDeclList const& other)
 	for (vector<ASTDataDecl*>::const_iterator it =
 		     other.declarations_.begin();
 	     it != other.declarations_.end(); ++it)
-		addDeclaration(*it);
+		addDeclaration((*it)->clone());
 }
 
 ASTDataDeclList& ASTDataDeclList::operator=(ASTDataDeclList const& rhs)
 {
+	if (this == &rhs) return *this;
+
 	ASTDecl::operator=(rhs);
 
-    baseType = rhs.baseType;
-    declarations_.clear();
+	baseType = rhs.baseType;
+	declarations_.clear();
 	for (vector<ASTDataDecl*>::const_iterator it = rhs.declarations_.begin();
 	     it != rhs.declarations_.end(); ++it)
-		addDeclaration(*it);
+		addDeclaration((*it)->clone());
 	
 	return *this;
 }
@@ -575,6 +577,7 @@ void ASTDataDecl::execute(ASTVisitor& visitor, void* param)
 void ASTDataDecl::setInitializer(ASTExpr* initializer)
 {
 	initializer_ = initializer;
+	if (!initializer) return;
 
 	// Give a string or array literal a reference back to this object so it
 	// can grab size information.
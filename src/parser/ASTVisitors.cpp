@@ -50,7 +50,8 @@ void RecursiveVisitor::handleError(CompileError const& error)
 
 	// Actually handle the error.
 	if (error.isStrict()) failure = true;
-	box_out_err(error);
+	if (errorLog) errorLog->push_back(error);
+	else box_out_err(error);
 }
 
 void RecursiveVisitor::visit(AST& node, void* param)
@@ -166,10 +166,15 @@ namespace ZScript
 	class RecursiveVisitor : public ASTVisitor, public CompileErrorHandler
 	{
 	public:
-		RecursiveVisitor() : failure(false), breakNode(NULL) {}
+		RecursiveVisitor()
+			: failure(false), breakNode(NULL), errorLog(NULL) {}
 	
 		// Mark as having failed.
 		void fail() {failure = true;}
+
+		// Keep errors in log instead of printing them, so that visitors run
+		// on worker threads can have their errors printed in order later.
+		void setErrorLog(std::vector<CompileError>* log) {errorLog = log;}
 	
 		// Used to signal that a compile error has occured.
 		void handleError(CompileError const& error) /*override*/;
@@ -276,6 +281,9 @@ namespace ZScript
 	
 		// Set to true if any errors have occured.
 		bool failure;
+
+		// Where errors go if they're not printed straight away.
+		std::vector<CompileError>* errorLog;
 	};
 }
 
@@ -1121,6 +1121,10 @@ namespace ZScript
 		{
 			return new LiteralArgument(value);
 		}
+		long getValue()
+		{
+			return value;
+		}
 	private:
 		long value;
 	};
@@ -1138,6 +1142,10 @@ namespace ZScript
 		{
 			return new VarArgument(ID);
 		}
+		int getID()
+		{
+			return ID;
+		}
 	private:
 		int ID;
 	};
@@ -1177,6 +1185,10 @@ namespace ZScript
 		{
 			return ID;
 		}
+		void setID(int id)
+		{
+			ID=id;
+		}
 		void setLineNo(int l)
 		{
 			haslineno=true;
@@ -83,23 +83,18 @@ namespace ZScript
 	class ScriptParser
 	{
 	public:
-		static int getUniqueVarID()
-		{
-			return vid++;
-		}
-		static int getUniqueFuncID()
-		{
-			return fid++;
-		}
-		static int getUniqueLabelID()
-		{
-			return lid++;
-		}
-		static int getUniqueGlobalID()
-		{
-			return gid++;
-		}
+		// These may be called from the code generation workers.
+		static int getUniqueVarID();
+		static int getUniqueFuncID();
+		static int getUniqueLabelID();
+		static int getUniqueGlobalID();
 		static bool preprocess(ASTFile* root, int reclevel);
+		// Parses a file, reusing the tree from an earlier compile if the
+		// file hasn't changed since. The caller owns the result.
+		static ASTFile* parseCachedFile(std::string const& filename);
+		// The absolute path of a file, used to tell whether two imports
+		// name the same file.
+		static std::string canonicalFilename(std::string const& filename);
 		static IntermediateData* generateOCode(FunctionData& fdata);
 		static void assemble(IntermediateData* id);
 		static void initialize();
@@ -111,11 +106,14 @@ namespace ZScript
 		static std::string prepareFilename(std::string const& filename);
 		static std::vector<Opcode *> assembleOne(
 				Program& program, std::vector<Opcode*> script,
-				int numparams);
-		static int vid;
-		static int fid;
-		static int gid;
-		static int lid;
+				int numparams, bool optimize);
+		// Worker pool tasks for generateOCode and assemble.
+		static void generateFunctionTask(void* data, int index);
+		static void assembleScriptTask(void* data, int index);
+		static volatile long vid;
+		static volatile long fid;
+		static volatile long gid;
+		static volatile long lid;
 	};
 }
 
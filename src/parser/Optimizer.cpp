@@ -0,0 +1,557 @@
+#include "../precompiled.h" // Always first.
+
+#include "Optimizer.h"
+#include "ByteCode.h"
+#include "BuildVisitors.h"
+#include <map>
+#include <set>
+#include <vector>
+
+using std::map;
+using std::set;
+using std::vector;
+using namespace ZScript;
+
+namespace // file local
+{
+	////////////////////////////////////////////////////////////////
+	// Instructions
+
+	// The opcodes the optimizer knows how to reason about.
+	enum Kind
+	{
+		K_OTHER,
+		K_SETV, K_SETR,
+		K_ADDV, K_ADDR, K_SUBV, K_SUBR,
+		K_MULTV, K_MULTR, K_DIVV, K_DIVR,
+		K_COMPAREV, K_COMPARER,
+		K_SETTRUE, K_SETFALSE, K_SETMORE, K_SETLESS,
+		K_PUSHR, K_POP, K_LOADI, K_STOREI,
+		K_GOTO, K_GOTOTRUE, K_GOTOFALSE, K_GOTOMORE, K_GOTOLESS,
+		K_GOTOR, K_QUIT, K_RETURN
+	};
+
+	Kind getKind(Opcode* op)
+	{
+		if (dynamic_cast<OSetImmediate*>(op)) return K_SETV;
+		if (dynamic_cast<OSetRegister*>(op)) return K_SETR;
+		if (dynamic_cast<OAddImmediate*>(op)) return K_ADDV;
+		if (dynamic_cast<OAddRegister*>(op)) return K_ADDR;
+		if (dynamic_cast<OSubImmediate*>(op)) return K_SUBV;
+		if (dynamic_cast<OSubRegister*>(op)) return K_SUBR;
+		if (dynamic_cast<OMultImmediate*>(op)) return K_MULTV;
+		if (dynamic_cast<OMultRegister*>(op)) return K_MULTR;
+		if (dynamic_cast<ODivImmediate*>(op)) return K_DIVV;
+		if (dynamic_cast<ODivRegister*>(op)) return K_DIVR;
+		if (dynamic_cast<OCompareImmediate*>(op)) return K_COMPAREV;
+		if (dynamic_cast<OCompareRegister*>(op)) return K_COMPARER;
+		if (dynamic_cast<OSetTrue*>(op)) return K_SETTRUE;
+		if (dynamic_cast<OSetFalse*>(op)) return K_SETFALSE;
+		if (dynamic_cast<OSetMore*>(op)) return K_SETMORE;
+		if (dynamic_cast<OSetLess*>(op)) return K_SETLESS;
+		if (dynamic_cast<OPushRegister*>(op)) return K_PUSHR;
+		if (dynamic_cast<OPopRegister*>(op)) return K_POP;
+		if (dynamic_cast<OLoadIndirect*>(op)) return K_LOADI;
+		if (dynamic_cast<OStoreIndirect*>(op)) return K_STOREI;
+		if (dynamic_cast<OGotoImmediate*>(op)) return K_GOTO;
+		if (dynamic_cast<OGotoTrueImmediate*>(op)) return K_GOTOTRUE;
+		if (dynamic_cast<OGotoFalseImmediate*>(op)) return K_GOTOFALSE;
+		if (dynamic_cast<OGotoMoreImmediate*>(op)) return K_GOTOMORE;
+		if (dynamic_cast<OGotoLessImmediate*>(op)) return K_GOTOLESS;
+		if (dynamic_cast<OGotoRegister*>(op)) return K_GOTOR;
+		if (dynamic_cast<OQuit*>(op)) return K_QUIT;
+		if (dynamic_cast<OReturn*>(op)) return K_RETURN;
+		return K_OTHER;
+	}
+
+	bool isBinary(Kind kind)
+	{
+		return (kind >= K_SETV && kind <= K_COMPARER)
+			|| kind == K_LOADI || kind == K_STOREI;
+	}
+
+	bool isUnary(Kind kind)
+	{
+		return (kind >= K_SETTRUE && kind <= K_POP)
+			|| (kind >= K_GOTO && kind <= K_GOTOR);
+	}
+
+	// Jumps to a label, conditionally or not.
+	bool isLabelJump(Kind kind)
+	{
+		return kind >= K_GOTO && kind <= K_GOTOLESS;
+	}
+
+	// Control never falls through to the next instruction.
+	bool endsFlow(Kind kind)
+	{
+		return kind == K_GOTO || kind == K_GOTOR
+			|| kind == K_QUIT || kind == K_RETURN;
+	}
+
+	struct Instr
+	{
+		Instr(Opcode* op) : op(op), kind(getKind(op)), dead(false) {}
+		Opcode* op;
+		Kind kind;
+		bool dead;
+
+		Argument* first() const
+		{
+			if (isBinary(kind))
+				return static_cast<BinaryOpcode*>(op)->getFirstArgument();
+			if (isUnary(kind))
+				return static_cast<UnaryOpcode*>(op)->getArgument();
+			return NULL;
+		}
+
+		Argument* second() const
+		{
+			if (isBinary(kind))
+				return static_cast<BinaryOpcode*>(op)->getSecondArgument();
+			return NULL;
+		}
+
+		bool hasLabel() const {return op->getLabel() != -1;}
+	};
+
+	////////////////////////////////////////////////////////////////
+	// Arguments
+
+	// Returns the D register named by the argument, or -1 if it isn't one.
+	// Only these are plain storage; every other register may have side
+	// effects when read or written.
+	int getDRegister(Argument* arg)
+	{
+		VarArgument* var = dynamic_cast<VarArgument*>(arg);
+		if (!var) return -1;
+		int id = var->getID();
+		if (id < INDEX || id > WHAT_NO_7) return -1;
+		return id;
+	}
+
+	optional<long> getLiteral(Argument* arg)
+	{
+		LiteralArgument* literal = dynamic_cast<LiteralArgument*>(arg);
+		if (!literal) return nullopt;
+		return literal->getValue();
+	}
+
+	// The script engine stores values in 32-bit longs; refuse to fold
+	// anything that would have wrapped at runtime.
+	optional<long> fitValue(long long value)
+	{
+		if (value < -2147483647LL - 1 || value > 2147483647LL) return nullopt;
+		return long(value);
+	}
+
+	////////////////////////////////////////////////////////////////
+	// Register effects
+
+	// An instruction is pure if its only effects on registers are reads and
+	// writes of its own D register arguments.
+	bool isPure(Instr const& in)
+	{
+		switch (in.kind)
+		{
+		case K_SETV: case K_SETR:
+		case K_ADDV: case K_ADDR: case K_SUBV: case K_SUBR:
+		case K_MULTV: case K_MULTR: case K_DIVV: case K_DIVR:
+		case K_COMPAREV: case K_COMPARER:
+		case K_SETTRUE: case K_SETFALSE: case K_SETMORE: case K_SETLESS:
+		case K_PUSHR: case K_POP: case K_LOADI: case K_STOREI:
+			break;
+		default:
+			return false;
+		}
+
+		Argument* args[2] = {in.first(), in.second()};
+		for (int i = 0; i < 2; ++i)
+		{
+			if (dynamic_cast<VarArgument*>(args[i])
+			    && getDRegister(args[i]) == -1)
+				return false;
+		}
+		return true;
+	}
+
+	// Only meaningful for pure instructions.
+	bool readsRegister(Instr const& in, int reg)
+	{
+		bool first = getDRegister(in.first()) == reg;
+		bool second = getDRegister(in.second()) == reg;
+		switch (in.kind)
+		{
+		case K_SETR: case K_LOADI:
+			return second;
+		case K_ADDV: case K_SUBV: case K_MULTV: case K_DIVV:
+		case K_COMPAREV: case K_PUSHR:
+			return first;
+		case K_ADDR: case K_SUBR: case K_MULTR: case K_DIVR:
+		case K_COMPARER: case K_STOREI:
+			return first || second;
+		default:
+			return false;
+		}
+	}
+
+	// Only meaningful for pure instructions.
+	bool writesRegister(Instr const& in, int reg)
+	{
+		switch (in.kind)
+		{
+		case K_COMPAREV: case K_COMPARER: case K_PUSHR: case K_STOREI:
+			return false;
+		default:
+			return getDRegister(in.first()) == reg;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////
+	// Editing
+
+	class RenameLabel : public ArgumentVisitor
+	{
+	public:
+		RenameLabel(int from, int to) : from(from), to(to) {}
+		void caseLabel(LabelArgument& host, void*)
+		{
+			if (host.getID() == from) host.setID(to);
+		}
+	private:
+		int from;
+		int to;
+	};
+
+	void renameLabel(vector<Instr>& code, int from, int to)
+	{
+		RenameLabel visitor(from, to);
+		for (vector<Instr>::iterator it = code.begin(); it != code.end(); ++it)
+			it->op->execute(visitor, NULL);
+	}
+
+	void replace(Instr& in, Opcode* op)
+	{
+		op->setLabel(in.op->getLabel());
+		delete in.op;
+		in = Instr(op);
+	}
+
+	// Deletes instructions marked dead. A dead instruction's label moves to
+	// the next live one, since jumping there now has the same effect.
+	// Returns true if anything was removed.
+	bool compact(vector<Instr>& code)
+	{
+		int nextLive = -1;
+		for (int i = int(code.size()) - 1; i >= 0; --i)
+		{
+			Instr& in = code[i];
+			if (!in.dead)
+			{
+				nextLive = i;
+				continue;
+			}
+			if (!in.hasLabel()) continue;
+
+			// Nothing to inherit the label.
+			if (nextLive == -1)
+			{
+				in.dead = false;
+				nextLive = i;
+				continue;
+			}
+
+			Opcode* next = code[nextLive].op;
+			if (next->getLabel() == -1)
+				next->setLabel(in.op->getLabel());
+			else
+				renameLabel(code, in.op->getLabel(), next->getLabel());
+			in.op->setLabel(-1);
+		}
+
+		vector<Instr> live;
+		for (vector<Instr>::iterator it = code.begin(); it != code.end(); ++it)
+		{
+			if (it->dead) delete it->op;
+			else live.push_back(*it);
+		}
+		bool changed = live.size() != code.size();
+		code.swap(live);
+		return changed;
+	}
+
+	////////////////////////////////////////////////////////////////
+	// Passes
+
+	// Labels nothing jumps to don't split blocks.
+	bool dropUnusedLabels(vector<Instr>& code)
+	{
+		set<int> used;
+		for (vector<Instr>::iterator it = code.begin(); it != code.end(); ++it)
+		{
+			GetLabels temp(used);
+			it->op->execute(temp, NULL);
+		}
+
+		bool changed = false;
+		for (vector<Instr>::iterator it = code.begin(); it != code.end(); ++it)
+		{
+			if (it->hasLabel() && !used.count(it->op->getLabel()))
+			{
+				it->op->setLabel(-1);
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	// Code between an unconditional transfer and the next label can't run.
+	bool markUnreachable(vector<Instr>& code)
+	{
+		bool changed = false;
+		bool reachable = true;
+		for (vector<Instr>::iterator it = code.begin(); it != code.end(); ++it)
+		{
+			if (it->hasLabel()) reachable = true;
+			if (!reachable)
+			{
+				it->dead = true;
+				changed = true;
+				continue;
+			}
+			if (endsFlow(it->kind)) reachable = false;
+		}
+		return changed;
+	}
+
+	// Jumps to a GOTO go straight to its target, and jumps to the very next
+	// instruction are dropped.
+	bool threadJumps(vector<Instr>& code)
+	{
+		map<int, int> indices;
+		for (int i = 0; i < int(code.size()); ++i)
+			if (code[i].hasLabel()) indices[code[i].op->getLabel()] = i;
+
+		bool changed = false;
+		for (int i = 0; i < int(code.size()); ++i)
+		{
+			Instr& in = code[i];
+			if (!isLabelJump(in.kind)) continue;
+			LabelArgument* target = dynamic_cast<LabelArgument*>(in.first());
+			if (!target) continue;
+
+			int label = target->getID();
+			set<int> seen;
+			seen.insert(label);
+			while (true)
+			{
+				map<int, int>::iterator found = indices.find(label);
+				if (found == indices.end()) break;
+				Instr& dest = code[found->second];
+				if (dest.kind != K_GOTO) break;
+				LabelArgument* next = dynamic_cast<LabelArgument*>(dest.first());
+				if (!next || seen.count(next->getID())) break;
+				label = next->getID();
+				seen.insert(label);
+			}
+
+			if (label != target->getID())
+			{
+				target->setID(label);
+				changed = true;
+			}
+
+			map<int, int>::iterator found = indices.find(label);
+			if (found != indices.end() && found->second == i + 1)
+			{
+				in.dead = true;
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	// PUSHR X; POP Y becomes SETR Y,X, or nothing when X is Y.
+	bool removePushPop(vector<Instr>& code)
+	{
+		bool changed = false;
+		for (int i = 0; i + 1 < int(code.size()); ++i)
+		{
+			Instr& push = code[i];
+			Instr& pop = code[i + 1];
+			if (push.kind != K_PUSHR || pop.kind != K_POP || pop.hasLabel())
+				continue;
+			// A removed PUSHR's label needs somewhere to go.
+			if (push.hasLabel() && i + 2 >= int(code.size())) continue;
+			int dest = getDRegister(pop.first());
+			if (dest == -1) continue;
+
+			if (getDRegister(push.first()) == dest)
+				push.dead = true;
+			else
+				replace(push, new OSetRegister(pop.first()->clone(),
+				                               push.first()->clone()));
+			pop.dead = true;
+			changed = true;
+			++i;
+		}
+		return changed;
+	}
+
+	// Folds and propagates the value of a SETV or D register SETR into the
+	// instruction right after it.
+	bool foldConstants(vector<Instr>& code)
+	{
+		bool changed = false;
+		for (int i = 0; i + 1 < int(code.size()); ++i)
+		{
+			Instr& store = code[i];
+			Instr& use = code[i + 1];
+			if (use.hasLabel()) continue;
+			int reg = getDRegister(store.first());
+			if (reg == -1) continue;
+
+			if (store.kind == K_SETR)
+			{
+				// SETR R,X; SETR S,R -> SETR R,X; SETR S,X
+				int source = getDRegister(store.second());
+				if (source == -1 || source == reg) continue;
+				if (use.kind == K_SETR && getDRegister(use.second()) == reg)
+				{
+					replace(use, new OSetRegister(use.first()->clone(),
+					                              store.second()->clone()));
+					changed = true;
+				}
+				continue;
+			}
+
+			if (store.kind != K_SETV) continue;
+			optional<long> value = getLiteral(store.second());
+			if (!value) continue;
+
+			// SETV R,a; ADDV R,b -> SETV R,a+b
+			if (getDRegister(use.first()) == reg)
+			{
+				optional<long> operand = getLiteral(use.second());
+				optional<long> folded;
+				if (operand)
+				{
+					long long a = *value, b = *operand;
+					switch (use.kind)
+					{
+					case K_ADDV: folded = fitValue(a + b); break;
+					case K_SUBV: folded = fitValue(a - b); break;
+					case K_MULTV: folded = fitValue((a * b) / 10000); break;
+					case K_DIVV:
+						if (b != 0) folded = fitValue((a * 10000) / b);
+						break;
+					default: break;
+					}
+				}
+				if (folded)
+				{
+					replace(store, new OSetImmediate(store.first()->clone(),
+					                               new LiteralArgument(*folded)));
+					use.dead = true;
+					changed = true;
+					++i;
+					continue;
+				}
+			}
+
+			// SETV R,a; ADDR S,R -> SETV R,a; ADDV S,a
+			if (getDRegister(use.second()) != reg) continue;
+			Argument* dest = use.first()->clone();
+			Argument* literal = new LiteralArgument(*value);
+			Opcode* op = NULL;
+			switch (use.kind)
+			{
+			case K_SETR: op = new OSetImmediate(dest, literal); break;
+			case K_ADDR: op = new OAddImmediate(dest, literal); break;
+			case K_SUBR: op = new OSubImmediate(dest, literal); break;
+			case K_MULTR: op = new OMultImmediate(dest, literal); break;
+			case K_DIVR: op = new ODivImmediate(dest, literal); break;
+			case K_COMPARER: op = new OCompareImmediate(dest, literal); break;
+			default: break;
+			}
+			if (op)
+			{
+				replace(use, op);
+				changed = true;
+			}
+			else
+			{
+				delete dest;
+				delete literal;
+			}
+		}
+		return changed;
+	}
+
+	// A SETV/SETR into a D register that is overwritten before anything in
+	// the same block reads it does nothing.
+	bool removeDeadStores(vector<Instr>& code)
+	{
+		bool changed = false;
+		for (int i = 0; i < int(code.size()); ++i)
+		{
+			Instr& store = code[i];
+			if (store.kind != K_SETV && store.kind != K_SETR) continue;
+			int reg = getDRegister(store.first());
+			if (reg == -1) continue;
+			if (store.kind == K_SETR)
+			{
+				int source = getDRegister(store.second());
+				if (source == -1) continue;
+				if (source == reg)
+				{
+					store.dead = true;
+					changed = true;
+					continue;
+				}
+			}
+
+			for (int j = i + 1; j < int(code.size()); ++j)
+			{
+				Instr const& next = code[j];
+				if (next.hasLabel() || !isPure(next)) break;
+				if (readsRegister(next, reg)) break;
+				if (writesRegister(next, reg))
+				{
+					store.dead = true;
+					changed = true;
+					break;
+				}
+			}
+		}
+		return changed;
+	}
+}
+
+void ZScript::optimizeCode(vector<Opcode*>& opcodes)
+{
+	vector<Instr> code;
+	for (vector<Opcode*>::iterator it = opcodes.begin(); it != opcodes.end(); ++it)
+		code.push_back(Instr(*it));
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		changed |= dropUnusedLabels(code);
+		changed |= markUnreachable(code);
+		changed |= compact(code);
+		changed |= threadJumps(code);
+		changed |= compact(code);
+		changed |= removePushPop(code);
+		changed |= compact(code);
+		changed |= foldConstants(code);
+		changed |= compact(code);
+		changed |= removeDeadStores(code);
+		changed |= compact(code);
+	}
+
+	opcodes.clear();
+	for (vector<Instr>::iterator it = code.begin(); it != code.end(); ++it)
+		opcodes.push_back(it->op);
+}
@@ -0,0 +1,21 @@
+// Peephole and dead-code optimizer for assembled ZASM.
+
+#ifndef ZSCRIPT_OPTIMIZER_H
+#define ZSCRIPT_OPTIMIZER_H
+
+#include <vector>
+
+namespace ZScript
+{
+	class Opcode;
+
+	// Simplifies a script's assembled code in place, before label line
+	// numbers are assigned. Performs constant folding, copy propagation,
+	// push/pop elimination, dead store removal, jump threading and removal
+	// of unreferenced labels and unreachable code. Only the general purpose
+	// D registers are treated as side-effect free; anything else is left
+	// untouched. Removed opcodes are deleted.
+	void optimizeCode(std::vector<Opcode*>& code);
+}
+
+#endif
@@ -2,16 +2,20 @@
 #include "../precompiled.h" //always first
 
 #include "../zsyssimple.h"
+#include "../zc_thread.h"
 #include "ByteCode.h"
 #include "CompileError.h"
 #include "CompileOption.h"
 #include "GlobalSymbols.h"
+#include "Optimizer.h"
 #include "y.tab.hpp"
 #include <iostream>
 #include <assert.h>
 #include <cstdlib>
+#include <cctype>
 #include <string>
 #include <memory>
+#include <set>
 
 #include "ASTVisitors.h"
 #include "DataStructs.h"
@@ -33,8 +37,85 @@ int main(int argc, char *argv[])
 }
 #endif
 
+namespace
+{
+	// Canonical paths of the files parsed by the current compile, so that
+	// each is only imported once.
+	set<string> importedFiles;
+
+	// Trees of the files parsed by earlier compiles, kept as they came out
+	// of the parser and reused while the file's contents are unchanged.
+	struct ParsedFile
+	{
+		unsigned long long hash;
+		ASTFile* tree;
+	};
+	map<string, ParsedFile> parsedFiles;
+
+	bool hashFile(string const& filename, unsigned long long& hash)
+	{
+		FILE* f = fopen(filename.c_str(), "rb");
+		if (!f) return false;
+
+		// FNV-1a
+		hash = 14695981039346656037ULL;
+		unsigned char buf[4096];
+		size_t count;
+		while ((count = fread(buf, 1, sizeof(buf), f)) > 0)
+			for (size_t i = 0; i < count; ++i)
+			{
+				hash ^= buf[i];
+				hash *= 1099511628211ULL;
+			}
+
+		fclose(f);
+		return true;
+	}
+
+	// Runs task(data, i) for each i below count, spread over a worker per
+	// processor. Tasks may run in any order, so each must write only its
+	// own results.
+	struct ParallelJob
+	{
+		void (*task)(void* data, int index);
+		void* data;
+		long count;
+		volatile long next;
+	};
+
+	void runParallelJob(void* arg)
+	{
+		ParallelJob& job = *(ParallelJob*)arg;
+		for (long i = zc_atomic_next(&job.next); i < job.count;
+		     i = zc_atomic_next(&job.next))
+			job.task(job.data, (int)i);
+	}
+
+	void runParallel(void (*task)(void*, int), void* data, int count)
+	{
+		ParallelJob job;
+		job.task = task;
+		job.data = data;
+		job.count = count;
+		job.next = 0;
+
+		// This thread works too, and picks up everything if no worker
+		// could be started.
+		vector<zc_thread*> workers;
+		int workerCount = min(zc_cpu_count(), count) - 1;
+		for (int i = 0; i < workerCount; ++i)
+			if (zc_thread* worker = zc_thread_create(runParallelJob, &job))
+				workers.push_back(worker);
+		runParallelJob(&job);
+		for (vector<zc_thread*>::iterator it = workers.begin();
+		     it != workers.end(); ++it)
+			zc_thread_join(*it);
+	}
+}
+
 void ScriptParser::initialize()
 {
+	importedFiles.clear();
 	vid = 0;
 	fid = 0;
 	gid = 1;
@@ -50,12 +131,13 @@ ScriptsData* ZScript::compile(string const& filename)
 	box_out("Pass 1: Parsing");
 	box_eol();
 
-	auto_ptr<ASTFile> root(parseFile(filename));
+	auto_ptr<ASTFile> root(ScriptParser::parseCachedFile(filename));
 	if (!root.get())
 	{
 		box_out_err(CompileError::CantOpenSource(NULL));
 		return NULL;
 	}
+	importedFiles.insert(ScriptParser::canonicalFilename(filename));
     
 	box_out("Pass 2: Preprocessing");
 	box_eol();
@@ -102,10 +184,30 @@ ScriptsData* ZScript::compile(string const& filename)
 	return result;
 }
 
-int ScriptParser::vid = 0;
-int ScriptParser::fid = 0;
-int ScriptParser::gid = 1;
-int ScriptParser::lid = 0;
+volatile long ScriptParser::vid = 0;
+volatile long ScriptParser::fid = 0;
+volatile long ScriptParser::gid = 1;
+volatile long ScriptParser::lid = 0;
+
+int ScriptParser::getUniqueVarID()
+{
+	return (int)zc_atomic_next(&vid);
+}
+
+int ScriptParser::getUniqueFuncID()
+{
+	return (int)zc_atomic_next(&fid);
+}
+
+int ScriptParser::getUniqueLabelID()
+{
+	return (int)zc_atomic_next(&lid);
+}
+
+int ScriptParser::getUniqueGlobalID()
+{
+	return (int)zc_atomic_next(&gid);
+}
 
 string ScriptParser::prepareFilename(string const& filename)
 {
@@ -121,7 +223,60 @@ string ScriptParser::prepareFilename(string const& filename)
 	}
 	return retval;
 }
-        
+
+string ScriptParser::canonicalFilename(string const& filename)
+{
+	string name = prepareFilename(filename);
+#ifdef _WIN32
+	char path[_MAX_PATH];
+	if (_fullpath(path, name.c_str(), _MAX_PATH))
+	{
+		name = path;
+		// Paths are case insensitive.
+		for (int i = 0; name[i]; ++i)
+			name[i] = tolower(name[i]);
+	}
+#else
+	if (char* path = realpath(name.c_str(), NULL))
+	{
+		name = path;
+		free(path);
+	}
+#endif
+	return name;
+}
+
+ASTFile* ScriptParser::parseCachedFile(string const& filename)
+{
+	string key = canonicalFilename(filename);
+	unsigned long long hash;
+	if (!hashFile(filename, hash))
+		return parseFile(filename);
+
+	map<string, ParsedFile>::iterator it = parsedFiles.find(key);
+	if (it != parsedFiles.end())
+	{
+		if (it->second.hash == hash)
+		{
+			// Nodes created later take their location from the file
+			// last parsed.
+			curfilename = filename;
+			return it->second.tree->clone();
+		}
+
+		delete it->second.tree;
+		parsedFiles.erase(it);
+	}
+
+	ASTFile* tree = parseFile(filename);
+	if (!tree) return NULL;
+
+	ParsedFile& parsed = parsedFiles[key];
+	parsed.hash = hash;
+	parsed.tree = tree->clone();
+	return tree;
+}
+
 bool ScriptParser::preprocess(ASTFile* root, int reclimit)
 {
 	assert(root);
@@ -138,9 +293,14 @@ bool ScriptParser::preprocess(ASTFile* root, int reclimit)
 	{
 		ASTImportDecl& importDecl = **it;
 
-		// Parse the imported file.
+		// Skip files that have already been imported, leaving the
+		// declaration without a tree.
 		string filename = prepareFilename(importDecl.getFilename());
-		auto_ptr<ASTFile> imported(parseFile(filename));
+		if (!importedFiles.insert(canonicalFilename(filename)).second)
+			continue;
+
+		// Parse the imported file.
+		auto_ptr<ASTFile> imported(parseCachedFile(filename));
 		if (!imported.get())
 		{
 			box_out_err(CompileError::CantOpenImport(&importDecl, filename));
@@ -158,6 +318,28 @@ bool ScriptParser::preprocess(ASTFile* root, int reclimit)
 	return true;
 }
 
+namespace
+{
+	// Code generation for each user function, one task per function.
+	struct FunctionTasks
+	{
+		Program* program;
+		vector<Function*> functions;
+		vector<vector<CompileError> > errors;
+		vector<char> failed; // Not vector<bool>; tasks write side by side.
+	};
+
+	// Assembly of each script, one task per script.
+	struct AssembleTask
+	{
+		Program* program;
+		Script* script;
+		vector<Opcode*> runCode;
+		int numparams;
+		bool optimize;
+	};
+}
+
 IntermediateData* ScriptParser::generateOCode(FunctionData& fdata)
 {
 	Program& program = fdata.program;
@@ -201,102 +383,130 @@ IntermediateData* ScriptParser::generateOCode(FunctionData& fdata)
 		rval->globalsInit.push_back(
 				new OPopRegister(new VarArgument(EXP2)));
         
-	//globals have been initialized, now we repeat for the functions
-	vector<Function*> funs = program.getUserFunctions();
-	for (vector<Function*>::iterator it = funs.begin();
-	     it != funs.end(); ++it)
+	//globals have been initialized, now we repeat for the functions.
+	// Labels and stack sizes are worked out on first use, so get them all
+	// now, before the workers need them.
+	vector<Function*> allFunctions = getFunctions(program);
+	for (vector<Function*>::iterator it = allFunctions.begin();
+	     it != allFunctions.end(); ++it)
+		(*it)->getLabel();
+
+	FunctionTasks tasks;
+	tasks.program = &program;
+	tasks.functions = program.getUserFunctions();
+	tasks.errors.resize(tasks.functions.size());
+	tasks.failed.resize(tasks.functions.size(), 0);
+	for (vector<Function*>::iterator it = tasks.functions.begin();
+	     it != tasks.functions.end(); ++it)
+		getStackSize(**it);
+
+	runParallel(generateFunctionTask, &tasks, tasks.functions.size());
+
+	// Report errors in the order the functions were declared.
+	for (size_t i = 0; i < tasks.functions.size(); ++i)
 	{
-		Function& function = **it;
-		ASTFuncDecl& node = *function.node;
+		for (vector<CompileError>::iterator it = tasks.errors[i].begin();
+		     it != tasks.errors[i].end(); ++it)
+			box_out_err(*it);
+		if (tasks.failed[i]) failure = true;
+	}
+    
+	if (failure)
+	{
+		delete rval;
+		return NULL;
+	}
+    
+	//Z_message("yes");
+	return rval;
+}
+
+void ScriptParser::generateFunctionTask(void* data, int index)
+{
+	FunctionTasks& tasks = *(FunctionTasks*)data;
+	Program& program = *tasks.program;
+	Function& function = *tasks.functions[index];
+	ASTFuncDecl& node = *function.node;
 
-		bool isRun = ZScript::isRun(function);
-		string scriptname;
-		Script* functionScript = function.getScript();
-		if (functionScript)
-			scriptname = functionScript->getName();
+	bool isRun = ZScript::isRun(function);
+	string scriptname;
+	Script* functionScript = function.getScript();
+	if (functionScript)
+		scriptname = functionScript->getName();
         
-		vector<Opcode *> funccode;
+	vector<Opcode *> funccode;
         
-		int stackSize = getStackSize(function);
+	int stackSize = getStackSize(function);
         
-		// Start of the function.
-		Opcode* first = new OSetImmediate(new VarArgument(EXP1),
-		                                  new LiteralArgument(0));
-		first->setLabel(function.getLabel());
-		funccode.push_back(first);
-
-		// Push on the this, if a script
-		if (isRun)
-		{
-			ScriptType type = program.getScript(scriptname)->getType();
-			if (type == ScriptType::ffc)
-				funccode.push_back(
-						new OSetRegister(new VarArgument(EXP2),
-						                 new VarArgument(REFFFC)));
-			else if (type == ScriptType::item)
-				funccode.push_back(
-						new OSetRegister(new VarArgument(EXP2),
-						                 new VarArgument(REFITEMCLASS)));
+	// Start of the function.
+	Opcode* first = new OSetImmediate(new VarArgument(EXP1),
+	                                  new LiteralArgument(0));
+	first->setLabel(function.getLabel());
+	funccode.push_back(first);
+
+	// Push on the this, if a script
+	if (isRun)
+	{
+		ScriptType type = program.getScript(scriptname)->getType();
+		if (type == ScriptType::ffc)
+			funccode.push_back(
+					new OSetRegister(new VarArgument(EXP2),
+					                 new VarArgument(REFFFC)));
+		else if (type == ScriptType::item)
+			funccode.push_back(
+					new OSetRegister(new VarArgument(EXP2),
+					                 new VarArgument(REFITEMCLASS)));
             
-			funccode.push_back(new OPushRegister(new VarArgument(EXP2)));
-		}
+		funccode.push_back(new OPushRegister(new VarArgument(EXP2)));
+	}
         
-		// Push 0s for the local variables.
-		for (int i = stackSize - getParameterCount(function); i > 0; --i)
-			funccode.push_back(new OPushRegister(new VarArgument(EXP1)));
+	// Push 0s for the local variables.
+	for (int i = stackSize - getParameterCount(function); i > 0; --i)
+		funccode.push_back(new OPushRegister(new VarArgument(EXP1)));
         
-		// Set up the stack frame register
-		funccode.push_back(new OSetRegister(new VarArgument(SFRAME),
-		                                    new VarArgument(SP)));
-		OpcodeContext oc(typeStore);
-		BuildOpcodes bo;
-		node.execute(bo, &oc);
+	// Set up the stack frame register
+	funccode.push_back(new OSetRegister(new VarArgument(SFRAME),
+	                                    new VarArgument(SP)));
+	OpcodeContext oc(&program.getTypeStore());
+	BuildOpcodes bo;
+	bo.setErrorLog(&tasks.errors[index]);
+	node.execute(bo, &oc);
         
-		if (bo.hasError()) failure = true;
+	if (bo.hasError()) tasks.failed[index] = true;
             
-		appendElements(funccode, bo.getResult());
-        
-		// Add appendix code.
-		Opcode* next = new OSetImmediate(new VarArgument(EXP2),
-		                                 new LiteralArgument(0));
-		next->setLabel(bo.getReturnLabelID());
-		funccode.push_back(next);
+	appendElements(funccode, bo.getResult());
         
-		// Pop off everything.
-		for (int i = 0; i < stackSize; ++i)
-		{
-			funccode.push_back(new OPopRegister(new VarArgument(EXP2)));
-		}
+	// Add appendix code.
+	Opcode* next = new OSetImmediate(new VarArgument(EXP2),
+	                                 new LiteralArgument(0));
+	next->setLabel(bo.getReturnLabelID());
+	funccode.push_back(next);
         
-		//if it's a main script, quit.
-		if (isRun)
-		{
-			// Note: the stack still contains the "this" pointer
-			// But since the script is about to terminate, we don't
-			// care about popping it off.
-			funccode.push_back(new OQuit());
-		}
-		else
-		{
-			// Not a script's run method, so no "this" pointer to
-			// pop off. The top of the stack is now the function
-			// return address (pushed on by the caller).
-			//pop off the return address
-			//and return
-			funccode.push_back(new OReturn());
-		}
+	// Pop off everything.
+	for (int i = 0; i < stackSize; ++i)
+	{
+		funccode.push_back(new OPopRegister(new VarArgument(EXP2)));
+	}
         
-		function.giveCode(funccode);
+	//if it's a main script, quit.
+	if (isRun)
+	{
+		// Note: the stack still contains the "this" pointer
+		// But since the script is about to terminate, we don't
+		// care about popping it off.
+		funccode.push_back(new OQuit());
 	}
-    
-	if (failure)
+	else
 	{
-		delete rval;
-		return NULL;
+		// Not a script's run method, so no "this" pointer to
+		// pop off. The top of the stack is now the function
+		// return address (pushed on by the caller).
+		//pop off the return address
+		//and return
+		funccode.push_back(new OReturn());
 	}
-    
-	//Z_message("yes");
-	return rval;
+        
+	function.giveCode(funccode);
 }
 
 void ScriptParser::assemble(IntermediateData *id)
@@ -316,8 +526,18 @@ void ScriptParser::assemble(IntermediateData *id)
 		ginit.push_back(new OGotoImmediate(new LabelArgument(label)));
 	}
     
+	// Each script is assembled on its own, reading the functions' code but
+	// leaving it alone.
+	vector<AssembleTask> tasks;
 	Script* init = program.getScript("~Init");
-	init->code = assembleOne(program, ginit, 0);
+	AssembleTask initTask;
+	initTask.program = &program;
+	initTask.script = init;
+	initTask.runCode = ginit;
+	initTask.numparams = 0;
+	initTask.optimize =
+		*lookupOption(init->getScope(), CompileOption::OPT_optimize);
+	tasks.push_back(initTask);
     
 	for (vector<Script*>::const_iterator it = program.scripts.begin();
 	     it != program.scripts.end(); ++it)
@@ -325,13 +545,29 @@ void ScriptParser::assemble(IntermediateData *id)
 		Script& script = **it;
 		if (script.getName() == "~Init") continue;
 		Function& run = *getRunFunction(script);
-		int numparams = getRunFunction(script)->paramTypes.size();
-		script.code = assembleOne(program, run.getCode(), numparams);
+		AssembleTask task;
+		task.program = &program;
+		task.script = &script;
+		task.runCode = run.getCode();
+		task.numparams = run.paramTypes.size();
+		task.optimize =
+			*lookupOption(script.getScope(), CompileOption::OPT_optimize);
+		tasks.push_back(task);
 	}
+
+	runParallel(assembleScriptTask, &tasks[0], tasks.size());
+}
+
+void ScriptParser::assembleScriptTask(void* data, int index)
+{
+	AssembleTask& task = ((AssembleTask*)data)[index];
+	task.script->code = assembleOne(*task.program, task.runCode,
+	                                task.numparams, task.optimize);
 }
 
 vector<Opcode*> ScriptParser::assembleOne(
-		Program& program, vector<Opcode*> runCode, int numparams)
+		Program& program, vector<Opcode*> runCode, int numparams,
+		bool optimize)
 {
 	vector<Opcode *> rval;
     
@@ -402,6 +638,9 @@ vector<Opcode*> ScriptParser::assembleOne(
 			rval.push_back((*it)->makeClone());
 	}
     
+	if (optimize)
+		optimizeCode(rval);
+    
 	// Set the label line numbers.
 	map<int, int> linenos;
 	int lineno = 1;
@@ -20,8 +20,27 @@
 
 #include "particles.h"
 
+static particle *layer_first[PARTICLE_LAYERS];
+static particle *layer_last[PARTICLE_LAYERS];
+
+static std::vector<pooled_particle> pooled[PARTICLE_LAYERS];
+static int pooled_count = 0;
+
+
 particle::~particle()
 {
+    if(bucket < 0)
+        return;
+        
+    if(layer_prev)
+        layer_prev->layer_next = layer_next;
+    else
+        layer_first[bucket] = layer_next;
+        
+    if(layer_next)
+        layer_next->layer_prev = layer_prev;
+    else
+        layer_last[bucket] = layer_prev;
 }
 
 bool particle::animate(int index)
@@ -47,57 +66,179 @@ particle::particle(fix X,fix Y,int L,int CS,int C) : sprite()
     cset=CS;
     color=C;
     yofs = 54;
+    
+    bucket = L - PARTICLE_MIN_LAYER;
+    layer_prev = layer_next = NULL;
+    
+    if(bucket < 0 || bucket >= PARTICLE_LAYERS)
+    {
+        bucket = -1;
+        return;
+    }
+    
+    layer_prev = layer_last[bucket];
+    
+    if(layer_prev)
+        layer_prev->layer_next = this;
+    else
+        layer_first[bucket] = this;
+        
+    layer_last[bucket] = this;
 }
 
-
-pFaroresWindDust::pFaroresWindDust(fix X,fix Y,int L,int CS,int C, int T) : particle(X,Y,L,CS,C)
+void draw_particles(BITMAP *dest, int layer)
 {
-    initialized=false;
-    timer=T;
+    int b = layer - PARTICLE_MIN_LAYER;
+    
+    if(b < 0 || b >= PARTICLE_LAYERS)
+        return;
+        
+    for(particle *p = layer_first[b]; p; p = p->layer_next)
+        p->draw(dest);
+        
+    for(std::vector<pooled_particle>::iterator p = pooled[b].begin(); p != pooled[b].end(); ++p)
+        putpixel(dest, fixtoi(p->x), fixtoi(p->y) + p->yofs, ((p->cset & 15) << CSET_SHFT) + p->color);
 }
 
-bool pFaroresWindDust::animate(int index)
+static pooled_particle *new_pooled_particle(int layer, fix x, fix y, int cset, int color)
 {
-    index=index;
+    int b = layer - PARTICLE_MIN_LAYER;
     
-    if(!initialized)
-    {
-        os=step;
-        ot=timer;
-        initialized=true;
-    }
+    if(b < 0 || b >= PARTICLE_LAYERS || pooled_count >= MAXPOOLEDPARTICLES)
+        return NULL;
+        
+    pooled[b].resize(pooled[b].size()+1);
+    ++pooled_count;
     
-    step=os*(double)timer/(double)ot;
+    pooled_particle *p = &pooled[b].back();
+    p->x = x.v;
+    p->y = y.v;
+    p->step = p->step0 = 0;
+    p->dx = p->dy = 0;
+    p->timer = p->timer0 = 0;
+    p->yofs = 54;
+    p->kind = ppSTILL;
+    p->cset = cset;
+    p->color = color;
+    return p;
+}
+
+void add_pooled_particle(int layer, int x, int y, int cset, int color, int timer)
+{
+    pooled_particle *p = new_pooled_particle(layer, (fix)x, (fix)y, cset, color);
     
-    if(timer>0)
+    if(p)
+        p->timer = timer;
+}
+
+void add_rising_particle(int layer, fix x, fix y, int cset, int color, int delay, fix step)
+{
+    pooled_particle *p = new_pooled_particle(layer, x, y, cset, color);
+    
+    if(p)
     {
-        --timer;
+        p->kind = ppRISE;
+        p->timer = delay;
+        p->step = step.v;
     }
-    
-    move(step);
-    return (!timer);
 }
 
-pTwilight::pTwilight(fix X,fix Y,int L,int CS,int C, int T) : particle(X,Y,L,CS,C)
+void add_drifting_particle(int layer, fix x, fix y, int yofs, int cset, int color, int timer, double angle, fix step)
 {
-    dir = up;
-    delay = T;
+    pooled_particle *p = new_pooled_particle(layer, x, y, cset, color);
+    
+    if(p)
+    {
+        p->kind = ppDRIFT;
+        p->yofs = yofs;
+        p->timer = p->timer0 = timer;
+        p->step0 = step.v;
+        p->dx = cos(angle);
+        p->dy = sin(angle);
+    }
 }
 
-bool pTwilight::animate(int index)
+// Moves a pooled particle one frame. Returns true when it's done.
+static bool animate_pooled_particle(pooled_particle &p)
 {
-    index=index;
+    fix x, y, step;
+    x.v = p.x;
+    y.v = p.y;
+    step.v = p.step;
     
-    if(delay>0)
+    switch(p.kind)
     {
-        delay--;
-    }
-    else
+    case ppRISE:
+        if(p.timer > 0)
+            --p.timer;
+        else
+            y -= step;
+            
+        p.y = y.v;
+        return y < 0;
+        
+    case ppDRIFT:
     {
-        move(step);
+        // Slows down linearly; one that starts with no time left is gone
+        // before it's drawn.
+        if(p.timer0 <= 0)
+            return true;
+            
+        fix step0;
+        step0.v = p.step0;
+        step = step0*(double)p.timer/(double)p.timer0;
+        
+        if(p.timer > 0)
+            --p.timer;
+            
+        x += p.dx*step;
+        y += p.dy*step;
+        p.x = x.v;
+        p.y = y.v;
+        p.step = step.v;
+        return !p.timer;
     }
     
-    return (y<0)!=0;
+    default:
+        if(p.timer <= 0)
+            return true;
+            
+        --p.timer;
+        return false;
+    }
+}
+
+void animate_pooled_particles()
+{
+    for(int b = 0; b < PARTICLE_LAYERS; b++)
+    {
+        std::vector<pooled_particle> &v = pooled[b];
+        size_t kept = 0;
+        
+        for(size_t i = 0; i < v.size(); i++)
+        {
+            if(animate_pooled_particle(v[i]))
+                continue;
+                
+            v[kept++] = v[i];
+        }
+        
+        pooled_count -= v.size() - kept;
+        v.resize(kept);
+    }
+}
+
+void clear_pooled_particles()
+{
+    for(int b = 0; b < PARTICLE_LAYERS; b++)
+        pooled[b].clear();
+        
+    pooled_count = 0;
+}
+
+int pooled_particle_count()
+{
+    return pooled_count;
 }
 
 
@@ -15,9 +15,15 @@
 #ifndef _PARTICLES_H_
 #define _PARTICLES_H_
 
+#include <vector>
 #include "sprite.h"
 #include "zdefs.h"
 
+// Particles are drawn on layers -3 to 5; any other layer is never drawn.
+#define PARTICLE_MIN_LAYER   -3
+#define PARTICLE_LAYERS      9
+#define MAXPOOLEDPARTICLES   65536
+
 class particle : public sprite
 {
 public:
@@ -27,27 +33,45 @@ public:
     virtual ~particle();
     virtual bool animate(int index);
     virtual void draw(BITMAP *dest);
+    
+private:
+    // Each layer's particles are linked in the order they were created, so
+    // that a layer can be drawn without going through all of them.
+    int bucket;
+    particle *layer_prev, *layer_next;
+    
+    friend void draw_particles(BITMAP *dest, int layer);
 };
 
-class pFaroresWindDust : public particle
-{
-public:
-    fix os;
-    int ot;
-    int timer;
-    bool initialized;
-    pFaroresWindDust(fix X,fix Y,int layer,int cset,int color,int timer);
-    virtual bool animate(int index);
-};
+// Single pixels kept in a plain array per layer instead of as sprites, so
+// an effect can have thousands of them.
+enum { ppSTILL, ppRISE, ppDRIFT };
 
-class pTwilight : public particle
+struct pooled_particle
 {
-public:
-    int delay;
-    pTwilight(fix X,fix Y,int layer,int cset,int color, int delay);
-    virtual bool animate(int index);
+    fixed x, y;
+    fixed step, step0;
+    double dx, dy; //direction of a ppDRIFT particle
+    int timer, timer0;
+    short yofs;
+    byte kind, cset, color;
 };
 
+// A pixel that's drawn until 'timer' more frames have been animated.
+void add_pooled_particle(int layer, int x, int y, int cset, int color, int timer);
+// Waits 'delay' frames, then rises 'step' pixels a frame until it leaves
+// the top of the screen (the Twilight and Sands of Hours warp effects).
+void add_rising_particle(int layer, fix x, fix y, int cset, int color, int delay, fix step);
+// Moves along 'angle', slowing from 'step' to a stop over 'timer' frames
+// (the default warp effect).
+void add_drifting_particle(int layer, fix x, fix y, int yofs, int cset, int color, int timer, double angle, fix step);
+void animate_pooled_particles();
+void clear_pooled_particles();
+int pooled_particle_count();
+
+// Draws the particles and pooled particles on one layer.
+void draw_particles(BITMAP *dest, int layer);
+
 
 
 
@@ -36,6 +36,7 @@
 #include "sfx.h"
 #include "md5.h"
 #include "ffscript.h"
+#include "zc_thread.h"
 //FFScript FFCore;
 extern FFScript FFCore;
 //FFSCript   FFEngine;
@@ -345,7 +346,6 @@ bool find_section(PACKFILE *f, long section_id_requested)
     bool catchup=false;
     word dummy;
     byte tempbyte;
-    char tempbuf[65536];
     
     
     switch(section_id_requested)
@@ -448,18 +448,9 @@ bool find_section(PACKFILE *f, long section_id_requested)
                 return false;
             }
             
-            //pack_fseek(f, section_size);
-            while(section_size>65535)
+            if(section_size>0 && pack_fseek(f, section_size)!=0)
             {
-                pfread(tempbuf,65535,f,true);
-                tempbuf[65535]=0;
-                section_size-=65535;
-            }
-            
-            if(section_size>0)
-            {
-                pfread(tempbuf,section_size,f,true);
-                tempbuf[section_size]=0;
+                return false;
             }
         }
         
@@ -656,17 +647,20 @@ bool valid_zqt(const char *filename)
 PACKFILE *open_quest_file(int *open_error, const char *filename, char *deletefilename, bool compressed,bool encrypted, bool show_progress)
 {
 	char tmpfilename[32];
-	temp_name(tmpfilename);
-	char percent_done[30];
-	int current_method=0;
+	tmpfilename[0]=0;
     
-	PACKFILE *f;
+	PACKFILE *f=NULL;
 	const char *passwd= encrypted ? datapwd : "";
+	byte *decoded=NULL;
+	long decodedsize=0;
     
 	// oldquest flag is set when an unencrypted qst file is suspected.
 	bool oldquest = false;
 	int ret;
     
+	if(deletefilename)
+		deletefilename[0]=0;
+        
 	if(show_progress)
 	{
 		box_start(1, "Loading Quest", lfont, font, true);
@@ -684,70 +678,33 @@ PACKFILE *open_quest_file(int *open_error, const char *filename, char *deletefil
 	if(encrypted)
 	{
 		box_out("Decrypting...");
-		box_save_x();
-		ret = decode_file_007(filename, tmpfilename, ENC_STR, ENC_METHOD_MAX-1, strstr(filename, ".dat#")!=NULL, passwd);
+		// The file doesn't record which method encoded it, so the decoder
+		// tries them all, newest first, on a single in-memory copy.
+		ret = decode_file_007_to_memory(filename, &decoded, &decodedsize, ENC_STR, ENC_METHOD_MAX-1, strstr(filename, ".dat#")!=NULL, passwd);
         
-		if(ret)
+		switch(ret)
 		{
-			switch(ret)
-			{
-			case 1:
-				box_out("error.");
-				box_eol();
-				box_end(true);
-				*open_error=qe_notfound;
-				return NULL;
-                
-			case 2:
-				box_out("error.");
-				box_eol();
-				box_end(true);
-				*open_error=qe_internal;
-				return NULL;
-				// be sure not to delete tmpfilename now...
-			}
-            
-			if(ret==5)                                              //old encryption?
-			{
-				current_method++;
-				sprintf(percent_done, "%d%%", (current_method*100)/ENC_METHOD_MAX);
-				box_out(percent_done);
-				box_load_x();
-				ret = decode_file_007(filename, tmpfilename, ENC_STR, ENC_METHOD_211B9, strstr(filename, ".dat#")!=NULL, passwd);
-			}
-            
-			if(ret==5)                                              //old encryption?
-			{
-				current_method++;
-				sprintf(percent_done, "%d%%", (current_method*100)/ENC_METHOD_MAX);
-				box_out(percent_done);
-				box_load_x();
-				ret = decode_file_007(filename, tmpfilename, ENC_STR, ENC_METHOD_192B185, strstr(filename, ".dat#")!=NULL, passwd);
-			}
+		case 0:
+			break;
             
-			if(ret==5)                                              //old encryption?
-			{
-				current_method++;
-				sprintf(percent_done, "%d%%", (current_method*100)/ENC_METHOD_MAX);
-				box_out(percent_done);
-				box_load_x();
-				ret = decode_file_007(filename, tmpfilename, ENC_STR, ENC_METHOD_192B105, strstr(filename, ".dat#")!=NULL, passwd);
-			}
+		case 1:
+			box_out("error.");
+			box_eol();
+			box_end(true);
+			*open_error=qe_notfound;
+			return NULL;
             
-			if(ret==5)                                              //old encryption?
-			{
-				current_method++;
-				sprintf(percent_done, "%d%%", (current_method*100)/ENC_METHOD_MAX);
-				box_out(percent_done);
-				box_load_x();
-				ret = decode_file_007(filename, tmpfilename, ENC_STR, ENC_METHOD_192B104, strstr(filename, ".dat#")!=NULL, passwd);
-			}
+		case 2:
+			box_out("error.");
+			box_eol();
+			box_end(true);
+			*open_error=qe_internal;
+			return NULL;
             
-			if(ret)
-			{
-				oldquest = true;
-				passwd="";
-			}
+		default:
+			oldquest = true;
+			passwd="";
+			break;
 		}
         
 		box_out("okay.");
@@ -759,34 +716,69 @@ PACKFILE *open_quest_file(int *open_error, const char *filename, char *deletefil
 	}
     
 	box_out("Opening...");
-	f = pack_fopen_password(oldquest ? filename : tmpfilename, compressed ? F_READ_PACKED : F_READ, passwd);
     
-	if(!f)
+	if(oldquest)
 	{
-		if((compressed==1)&&(errno==EDOM))
+		f = pack_fopen_password(filename, compressed ? F_READ_PACKED : F_READ, passwd);
+        
+		if(!f && (compressed==1)&&(errno==EDOM))
 		{
-			f = pack_fopen_password(oldquest ? filename : tmpfilename, F_READ, passwd);
+			f = pack_fopen_password(filename, F_READ, passwd);
 		}
+	}
+	else
+	{
+		f = pack_fopen_memory_password(decoded, decodedsize, compressed, passwd);
         
-		if(!f)
+		if(!f && (compressed==1)&&(errno==EDOM))
+		{
+			f = pack_fopen_memory_password(decoded, decodedsize, false, passwd);
+		}
+		else if(!f && errno==EINVAL)
 		{
-			if(!oldquest)
+			// Old-style packfile encryption; let Allegro read it from disk.
+			temp_name(tmpfilename);
+			FILE *tmp = fopen(tmpfilename, "wb");
+            
+			if(tmp)
 			{
-				delete_file(tmpfilename);
+				bool written = fwrite(decoded, 1, decodedsize, tmp)==size_t(decodedsize);
+				fclose(tmp);
+                
+				if(written)
+				{
+					f = pack_fopen_password(tmpfilename, compressed ? F_READ_PACKED : F_READ, passwd);
+					
+					if(!f && (compressed==1)&&(errno==EDOM))
+					{
+						f = pack_fopen_password(tmpfilename, F_READ, passwd);
+					}
+				}
 			}
             
-			box_out("error.");
-			box_eol();
-			box_end(true);
-			*open_error=qe_invalid;
-			return NULL;
+			if(f && deletefilename)
+				sprintf(deletefilename, "%s", tmpfilename);
+			else if(!f)
+				delete_file(tmpfilename);
+                
+			zc_free(decoded);
+			decoded=NULL;
+		}
+        
+		// On success the memory packfile owns the buffer.
+		if(!f && decoded)
+		{
+			zc_free(decoded);
 		}
 	}
     
-	if(!oldquest)
+	if(!f)
 	{
-		if(deletefilename)
-			sprintf(deletefilename, "%s", tmpfilename);
+		box_out("error.");
+		box_eol();
+		box_end(true);
+		*open_error=qe_invalid;
+		return NULL;
 	}
     
 	box_out("okay.");
@@ -15086,6 +15078,219 @@ void portBombRules()
 	
 }
 
+// Sections loadquest() knows how to read.
+static bool is_quest_section(dword id)
+{
+    switch(id)
+    {
+    case ID_RULES:
+    case ID_STRINGS:
+    case ID_MISC:
+    case ID_TILES:
+    case ID_COMBOS:
+    case ID_COMBOALIASES:
+    case ID_CSETS:
+    case ID_MAPS:
+    case ID_DMAPS:
+    case ID_DOORS:
+    case ID_ITEMS:
+    case ID_WEAPONS:
+    case ID_COLORS:
+    case ID_ICONS:
+    case ID_INITDATA:
+    case ID_GUYS:
+    case ID_LINKSPRITES:
+    case ID_SUBSCREEN:
+    case ID_FFSCRIPT:
+    case ID_SFX:
+    case ID_MIDIS:
+    case ID_CHEATS:
+    case ID_ITEMDROPSETS:
+    case ID_FAVORITES:
+        return true;
+    }
+    
+    return false;
+}
+
+struct quest_section
+{
+    dword id;
+    long offset; // start of the section's version info, just past the id
+    long size;   // version info, size and data
+};
+
+// Builds an index of the sections in the decompressed quest data that
+// follows the header. Returns false unless every section has a known id
+// and they chain together exactly to the end of the data; such quests
+// are only read in order.
+static bool index_quest_sections(const byte *buf, long size, std::vector<quest_section> &sections)
+{
+    long pos=0;
+    
+    while(pos<size)
+    {
+        if(size-pos<12)
+        {
+            return false;
+        }
+        
+        quest_section s;
+        s.id=(dword(buf[pos])<<24)|(dword(buf[pos+1])<<16)|(dword(buf[pos+2])<<8)|dword(buf[pos+3]);
+        s.offset=pos+4;
+        dword section_size=dword(buf[pos+8])|(dword(buf[pos+9])<<8)|(dword(buf[pos+10])<<16)|(dword(buf[pos+11])<<24);
+        
+        if(!is_quest_section(s.id) || section_size>dword(size-pos-12))
+        {
+            return false;
+        }
+        
+        s.size=8+long(section_size);
+        sections.push_back(s);
+        pos=s.offset+s.size;
+    }
+    
+    return true;
+}
+
+// Reads everything left in f into a zc_malloc'd buffer.
+static byte *read_packfile_remainder(PACKFILE *f, long *size)
+{
+    long capacity=1<<20, used=0;
+    byte *buf=(byte *)zc_malloc(capacity);
+    
+    while(buf)
+    {
+        used+=pack_fread(buf+used, capacity-used, f);
+        
+        if(pack_ferror(f))
+        {
+            zc_free(buf);
+            return NULL;
+        }
+        
+        if(used<capacity)
+        {
+            break;
+        }
+        
+        byte *grown=(byte *)zc_malloc(capacity*2);
+        
+        if(grown)
+        {
+            memcpy(grown, buf, used);
+        }
+        
+        zc_free(buf);
+        buf=grown;
+        capacity*=2;
+    }
+    
+    *size=used;
+    return buf;
+}
+
+// The tile section is most of a large quest, and readtiles() only
+// touches the tile buffers, so it can be read on a worker thread while
+// loadquest() reads the other sections.
+struct tile_section_job
+{
+    PACKFILE *f;
+    zquestheader header;
+    bool keepdata;
+    int ret;
+};
+
+static void read_tile_section(void *arg)
+{
+    tile_section_job *job=(tile_section_job *)arg;
+    job->ret=readtiles(job->f, newtilebuf, &job->header, job->header.zelda_version, job->header.build, 0, NEWMAXTILES, false, job->keepdata);
+}
+
+// The decompressed quest and the tile worker reading from it. Whichever
+// way loadquest() returns, the worker is joined before the data is freed.
+struct quest_load_data
+{
+    byte *data;
+    zc_thread *tiles;
+    tile_section_job tilejob;
+    
+    quest_load_data(): data(NULL), tiles(NULL)
+    {
+        tilejob.f=NULL;
+        tilejob.ret=0;
+    }
+    
+    ~quest_load_data()
+    {
+        join_tiles();
+        
+        if(data)
+        {
+            zc_free(data);
+        }
+    }
+    
+    // Starts reading the tile section on a worker, if the quest has one
+    // that doesn't depend on other sections.
+    void start_tiles(const std::vector<quest_section> &sections, const zquestheader &header, bool keepdata)
+    {
+        const quest_section *tilesection=NULL;
+        
+        for(unsigned int i=0; i<sections.size(); ++i)
+        {
+            if(sections[i].id==ID_TILES)
+            {
+                if(tilesection)
+                {
+                    return;
+                }
+                
+                tilesection=&sections[i];
+            }
+        }
+        
+        // Older quests fix up tiles using rules and weapon sprites.
+        if(!tilesection || !header.data_flags[ZQ_TILES] ||
+                (header.zelda_version < 0x211)||((header.zelda_version == 0x211)&&(header.build<7)))
+        {
+            return;
+        }
+        
+        tilejob.f=pack_fopen_memory(data+tilesection->offset, tilesection->size);
+        tilejob.header=header;
+        tilejob.keepdata=keepdata;
+        tilejob.ret=0;
+        
+        if(tilejob.f)
+        {
+            uncounted_pack=tilejob.f;
+            tiles=zc_thread_create(read_tile_section, &tilejob);
+        }
+        
+        if(!tiles && tilejob.f)
+        {
+            uncounted_pack=NULL;
+            pack_fclose(tilejob.f);
+            tilejob.f=NULL;
+        }
+    }
+    
+    int join_tiles()
+    {
+        if(tiles)
+        {
+            zc_thread_join(tiles);
+            tiles=NULL;
+            uncounted_pack=NULL;
+            pack_fclose(tilejob.f);
+            tilejob.f=NULL;
+        }
+        
+        return tilejob.ret;
+    }
+};
+
 int loadquest(const char *filename, zquestheader *Header, miscQdata *Misc, zctune *tunes, bool show_progress, bool compressed, bool encrypted, bool keepall, byte *skip_flags)
 {
     combosread=false;
@@ -15162,6 +15367,8 @@ int loadquest(const char *filename, zquestheader *Header, miscQdata *Misc, zctun
     if(!f)
         return open_error;
         
+    quest_load_data loaded;
+    bool tiles_in_background=false;
     int ret=0;
     
     //header
@@ -15175,6 +15382,30 @@ int loadquest(const char *filename, zquestheader *Header, miscQdata *Misc, zctun
     if(tempheader.zelda_version>=0x193)
     {
         dword section_id;
+        long datasize=0;
+        std::vector<quest_section> sections;
+        
+        // Decompress the rest of the quest once, then read it from memory.
+        loaded.data=read_packfile_remainder(f, &datasize);
+        
+        if(!loaded.data)
+        {
+            goto invalid;
+        }
+        
+        pack_fclose(f);
+        f=pack_fopen_memory(loaded.data, datasize);
+        
+        if(!f)
+        {
+            goto invalid;
+        }
+        
+        if(index_quest_sections(loaded.data, datasize, sections))
+        {
+            loaded.start_tiles(sections, tempheader, keepall&&!get_bit(skip_flags, skip_tiles));
+            tiles_in_background=(loaded.tiles!=NULL);
+        }
         
         //section id
         if(!p_mgetl(&section_id,f,true))
@@ -15247,6 +15478,21 @@ int loadquest(const char *filename, zquestheader *Header, miscQdata *Misc, zctun
                     catchup=false;
                 }
                 
+                if(tiles_in_background)
+                {
+                    // Already being read on the worker; skip over it.
+                    word section_version;
+                    dword section_size;
+                    
+                    if(!p_igetw(&section_version,f,true) || !p_igetw(&section_version,f,true) ||
+                            !p_igetl(&section_size,f,true) || pack_fseek(f, section_size)!=0)
+                    {
+                        goto invalid;
+                    }
+                    
+                    break;
+                }
+                
                 box_out("Reading Tiles...");
                 ret=readtiles(f, newtilebuf, &tempheader, tempheader.zelda_version, tempheader.build, 0, NEWMAXTILES, false, keepall&&!get_bit(skip_flags, skip_tiles));
                 checkstatus(ret);
@@ -15665,6 +15911,15 @@ int loadquest(const char *filename, zquestheader *Header, miscQdata *Misc, zctun
                 }
             }
         }
+        
+        if(tiles_in_background)
+        {
+            box_out("Reading Tiles...");
+            ret=loaded.join_tiles();
+            checkstatus(ret);
+            box_out("okay.");
+            box_eol();
+        }
     }
     else
     {
@@ -0,0 +1,290 @@
+//--------------------------------------------------------
+//  Zelda Classic
+//
+//  replay.cpp
+//
+//  Input recording and playback.
+//
+//--------------------------------------------------------
+
+#include "precompiled.h" //always first
+
+#include <string.h>
+#include "zc_alleg.h"
+#include "zdefs.h"
+#include "replay.h"
+#include "zelda.h"
+#include "link.h"
+#include "zsys.h"
+
+extern LinkClass Link;
+
+#define REPLAY_MAGIC   "ZCRP"
+#define REPLAY_VERSION 1
+
+// Record tags. Each frame is an rp_frame with the frame's hash, preceded by
+// an rp_input for every load_control_state() call in it that changed the
+// controls, and by an rp_seed if a game started during it.
+enum { rp_end, rp_seed, rp_input, rp_frame };
+
+static int mode = REPLAY_OFF;
+static PACKFILE *replay_file = NULL;
+static bool started = false; // Nothing is recorded before the first game starts
+static int next_tag = EOF;   // Read ahead while playing
+static dword last_input = 0;
+static long frames = 0;
+static long mismatches = 0;
+static long first_mismatch = -1;
+
+static void read_next_tag()
+{
+    next_tag = pack_getc(replay_file);
+}
+
+static dword pack_controls(const bool *state)
+{
+    dword bits = 0;
+    
+    for(int i=0; i<18; i++)
+    {
+        if(state[i])
+            bits |= 1<<i;
+    }
+    
+    return bits;
+}
+
+static inline dword fnv1a(dword h, const byte *p, long n)
+{
+    for(long i=0; i<n; i++)
+    {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    
+    return h;
+}
+
+static inline dword fnv1a(dword h, long v)
+{
+    return fnv1a(h, (const byte *)&v, sizeof(v));
+}
+
+// Hashes the frame and the state most likely to show a divergence first.
+static dword frame_hash()
+{
+    dword h = 2166136261u;
+    
+    if(framebuf)
+    {
+        long rowsize = framebuf->w * BYTES_PER_PIXEL(bitmap_color_depth(framebuf));
+        
+        for(int y=0; y<framebuf->h; y++)
+        {
+            h = fnv1a(h, framebuf->line[y], rowsize);
+        }
+    }
+    
+    h = fnv1a(h, frame);
+    h = fnv1a(h, currdmap);
+    h = fnv1a(h, currscr);
+    h = fnv1a(h, int(Link.getX()));
+    h = fnv1a(h, int(Link.getY()));
+    h = fnv1a(h, guys.Count());
+    
+    if(game)
+    {
+        for(int i=0; i<32; i++)
+        {
+            h = fnv1a(h, game->get_counter(i));
+        }
+    }
+    
+    return h;
+}
+
+bool replay_record(const char *filename)
+{
+    replay_stop();
+    replay_file = pack_fopen(filename, F_WRITE_PACKED);
+    
+    if(!replay_file)
+    {
+        Z_message("Could not create replay file %s\n", filename);
+        return false;
+    }
+    
+    pack_fwrite(REPLAY_MAGIC, 4, replay_file);
+    pack_iputw(REPLAY_VERSION, replay_file);
+    mode = REPLAY_RECORD;
+    Z_message("Recording replay to %s\n", filename);
+    return true;
+}
+
+bool replay_play(const char *filename)
+{
+    replay_stop();
+    replay_file = pack_fopen(filename, F_READ_PACKED);
+    
+    if(!replay_file)
+    {
+        Z_message("Could not open replay file %s\n", filename);
+        return false;
+    }
+    
+    char magic[4];
+    
+    if(pack_fread(magic, 4, replay_file) != 4 || memcmp(magic, REPLAY_MAGIC, 4) || pack_igetw(replay_file) != REPLAY_VERSION)
+    {
+        Z_message("%s is not a replay file\n", filename);
+        pack_fclose(replay_file);
+        replay_file = NULL;
+        return false;
+    }
+    
+    read_next_tag();
+    mode = REPLAY_PLAY;
+    Z_message("Playing replay %s\n", filename);
+    return true;
+}
+
+void replay_stop()
+{
+    if(mode == REPLAY_RECORD)
+    {
+        pack_putc(rp_end, replay_file);
+        Z_message("Recorded %ld frames\n", frames);
+    }
+    else if(mode == REPLAY_PLAY)
+    {
+        if(mismatches)
+            Z_message("Replay ended after %ld frames; %ld did not match, the first at frame %ld\n", frames, mismatches, first_mismatch);
+        else
+            Z_message("Replay ended after %ld frames; all matched\n", frames);
+    }
+    
+    if(replay_file)
+    {
+        pack_fclose(replay_file);
+        replay_file = NULL;
+    }
+    
+    mode = REPLAY_OFF;
+    started = false;
+    next_tag = EOF;
+    last_input = 0;
+    frames = mismatches = 0;
+    first_mismatch = -1;
+}
+
+int replay_mode()
+{
+    return mode;
+}
+
+// Stops playing when the recording has nothing left, or when it no longer
+// lines up with what the game is doing.
+static void replay_lost(const char *expected)
+{
+    if(next_tag != rp_end && next_tag != EOF)
+        Z_message("Replay lost sync at frame %ld, expecting %s\n", frames, expected);
+        
+    replay_stop();
+}
+
+unsigned int replay_seed(unsigned int seed)
+{
+    if(mode == REPLAY_RECORD)
+    {
+        pack_putc(rp_seed, replay_file);
+        pack_iputl(seed, replay_file);
+        pack_iputl(frame, replay_file);
+        started = true;
+    }
+    else if(mode == REPLAY_PLAY)
+    {
+        if(next_tag != rp_seed)
+        {
+            if(started)
+                replay_lost("the start of a game");
+                
+            return seed;
+        }
+        
+        // Animation and drunkenness run off the frame count, which depends on
+        // how long the title screen was up for.
+        seed = pack_igetl(replay_file);
+        frame = pack_igetl(replay_file);
+        read_next_tag();
+        started = true;
+    }
+    
+    return seed;
+}
+
+void replay_input(bool *state)
+{
+    if(!started)
+        return;
+        
+    if(mode == REPLAY_RECORD)
+    {
+        dword bits = pack_controls(state);
+        
+        if(bits != last_input)
+        {
+            pack_putc(rp_input, replay_file);
+            pack_iputl(bits, replay_file);
+            last_input = bits;
+        }
+    }
+    else if(mode == REPLAY_PLAY)
+    {
+        if(next_tag == rp_input)
+        {
+            last_input = pack_igetl(replay_file);
+            read_next_tag();
+        }
+        
+        for(int i=0; i<18; i++)
+        {
+            state[i] = (last_input & (1<<i)) != 0;
+        }
+    }
+}
+
+void replay_frame()
+{
+    if(!started)
+        return;
+        
+    if(mode == REPLAY_RECORD)
+    {
+        pack_putc(rp_frame, replay_file);
+        pack_iputl(frame_hash(), replay_file);
+        ++frames;
+    }
+    else if(mode == REPLAY_PLAY)
+    {
+        if(next_tag != rp_frame)
+        {
+            replay_lost("a frame");
+            return;
+        }
+        
+        dword recorded = pack_igetl(replay_file);
+        read_next_tag();
+        
+        if(recorded != frame_hash())
+        {
+            if(!mismatches)
+            {
+                first_mismatch = frames;
+                Z_message("Replay diverged at frame %ld\n", frames);
+            }
+            
+            ++mismatches;
+        }
+        
+        ++frames;
+    }
+}
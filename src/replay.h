@@ -0,0 +1,30 @@
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include "zdefs.h"
+
+// Records the game's input to a file, or plays a recording back, so that a
+// session can be run again exactly. The RNG seed and frame count are
+// recorded when each game starts, the controls whenever they change, and a
+// hash of the frame and of Link's state every frame, so that a replay can
+// tell when it stops matching the recording.
+
+enum { REPLAY_OFF, REPLAY_RECORD, REPLAY_PLAY };
+
+bool replay_record(const char *filename);
+bool replay_play(const char *filename);
+void replay_stop();
+int replay_mode();
+
+// Called when a game starts; returns the seed to pass to srand(). When
+// playing, also restores the frame count the game started on.
+unsigned int replay_seed(unsigned int seed);
+
+// Called by load_control_state() with the 18 controls it just read.
+// Records them, or replaces them with the recorded ones.
+void replay_input(bool *state);
+
+// Called once per frame, after the frame has been drawn to framebuf.
+void replay_frame();
+
+#endif
@@ -12,6 +12,7 @@
 #include "tiles.h"
 #include "zelda.h"
 #include "ffscript.h"
+#include "frametiming.h"
 extern FFScript FFCore;
 extern refInfo *ri;
 #include <stdio.h>
@@ -1325,12 +1326,15 @@ void do_fasttiler(BITMAP *bmp, int *sdci, int xoffset, int yoffset)
 {
     /* layer, x, y, tile, color opacity */
     
-    int opacity = sdci[6]/10000;
+    tile_blit b;
+    b.tile = sdci[4]/10000;
+    b.x = xoffset+(sdci[2]/10000);
+    b.y = yoffset+(sdci[3]/10000);
+    b.cset = sdci[5]/10000;
+    b.flip = 0;
+    b.opacity = sdci[6]/10000;
     
-    if(opacity < 128)
-        overtiletranslucent16(bmp, sdci[4]/10000, xoffset+(sdci[2]/10000), yoffset+(sdci[3]/10000), sdci[5]/10000, 0, opacity);
-    else
-        overtile16(bmp, sdci[4]/10000, xoffset+(sdci[2]/10000), yoffset+(sdci[3]/10000), sdci[5]/10000, 0);
+    blit_tile_batch(bmp, &b, 1, true, true);
 }
 
 void do_fasttilesr(BITMAP *bmp, int *sdci, int xoffset, int yoffset)
@@ -1351,14 +1355,21 @@ void do_fasttilesr(BITMAP *bmp, int *sdci, int xoffset, int yoffset)
 		
     }
 	
-    for ( int q = 0; q < sz; q+=5 )
+    std::vector<tile_blit> blits(sz/5);
+    
+    for ( int q = 0; q+4 < sz; q+=5 )
     {
-	    
-	    if(points[q+4] < 128)
-		overtiletranslucent16(bmp, points[q], xoffset+(points[q+1]), yoffset+(points[q+2]), points[q+3], 0, points[q+4]);
-	    else
-		overtile16(bmp, points[q], xoffset+(points[q+1]), yoffset+(points[q+2]), points[q+3], 0);
+	    tile_blit &b = blits[q/5];
+	    b.tile = points[q];
+	    b.x = xoffset+(points[q+1]);
+	    b.y = yoffset+(points[q+2]);
+	    b.cset = points[q+3];
+	    b.flip = 0;
+	    b.opacity = points[q+4];
     }
+    
+    if(!blits.empty())
+	    blit_tile_batch(bmp, &blits[0], (int)blits.size(), true, true);
 }
 
 
@@ -7009,9 +7020,11 @@ void do_primitives(BITMAP *targetBitmap, int type, mapscr *, int xoff, int yoff)
     //was this next variable ever used? -- DN
     //bool drawsubscr=false;
     
-    if(type > 7)
+    if(type < 0 || type >= CScriptDrawingCommands::NumLayers)
         return;
         
+    frame_phase_timer timer(fpPRIMITIVES);
+    
     //--script_drawing_commands[][] reference--
     //[][0]: type
     //[][1-16]: defined by type
@@ -7023,22 +7036,19 @@ void do_primitives(BITMAP *targetBitmap, int type, mapscr *, int xoff, int yoff)
     const bool brokenOffset=get_bit(extra_rules, er_BITMAPOFFSET)!=0;
     
     bool isTargetOffScreenBmp = false;
-    const int type_mul_10000 = type * 10000;
-    const int numDrawCommandsToProcess = script_drawing_commands.Count();
+    const std::vector<int>& layerCommands = script_drawing_commands.GetLayer(type);
     int xoffset=xoff, yoffset=yoff;
     
-    for(int i(0); i < numDrawCommandsToProcess; ++i)
+    for(size_t n(0); n < layerCommands.size(); ++n)
     {
         if(!brokenOffset)
         {
             xoffset = 0;
             yoffset = 0;
         }
+        const int i = layerCommands[n];
         int *sdci = &script_drawing_commands[i][0];
         
-        if(sdci[1] != type_mul_10000)
-            continue;
-            
         // get the correct render target, if set.
         BITMAP *bmp = zscriptDrawingRenderTarget->GetTargetBitmap(sdci[18]);
         
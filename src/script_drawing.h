@@ -281,6 +281,7 @@ public:
     
     // Unlikely people will be using all 1000 commands.
     const static int DefaultCapacity = 256; //176 + some extra
+    const static int NumLayers = 8;
     
     CScriptDrawingCommands() : commands(), count(0) {}
     ~CScriptDrawingCommands() {}
@@ -306,10 +307,12 @@ public:
         if(commands.empty())
             return;
             
-        //only clear what was used.
-        memset((void*)&commands[0], 0, count * sizeof(CScriptDrawingCommandVars));
+        //commands are zeroed as they are handed out by GetNext().
         count = 0;
         
+        for(int i(0); i < NumLayers; ++i)
+            layer_commands[i].clear();
+            
         draw_container.Clear();
     }
     
@@ -348,9 +351,29 @@ public:
             }
         }
         
+        commands[next_index].Clear();
         return next_index;
     }
     
+    // Files a filled-in command under the layer in its [1] slot, so that
+    // do_primitives() only has to visit the commands for the layer it is
+    // drawing. Commands keep the order they were submitted in. Commands with
+    // a layer outside 0-7 are never drawn and are simply dropped.
+    void Submit(const int index)
+    {
+        const int layer = commands[index][1];
+        
+        if(layer < 0 || layer % 10000 != 0 || layer / 10000 >= NumLayers)
+            return;
+            
+        layer_commands[layer / 10000].push_back(index);
+    }
+    
+    const std::vector<int>& GetLayer(const int layer) const
+    {
+        return layer_commands[layer];
+    }
+    
     reference operator [](const int i)
     {
         return commands[i];
@@ -380,6 +403,7 @@ public:
 protected:
     vec_type commands;
     int count;
+    std::vector<int> layer_commands[NumLayers];
     
     DrawingContainer draw_container;
     ScriptDrawingBitmapPool bitmap_pool;
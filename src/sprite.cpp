@@ -712,12 +712,15 @@ void sprite::drawshadow(BITMAP* dest,bool translucent)
 
 //class enemy;
 
-sprite_list::sprite_list() : count(0) {}
+sprite_list::sprite_list() : count(0)
+{
+    for(int i=0; i<SLUIDHASH; i++)
+        uids[i].s=NULL;
+}
+
 void sprite_list::clear()
 {
     while(count>0) del(0);
-    lastUIDRequested=0;
-    lastSpriteRequested=0;
 }
 
 sprite *sprite_list::spr(int index)
@@ -736,8 +739,6 @@ bool sprite_list::swap(int a,int b)
     sprite *c = sprites[a];
     sprites[a] = sprites[b];
     sprites[b] = c;
-    containedUIDs[sprites[a]->getUID()] = a;
-    containedUIDs[sprites[b]->getUID()] = b;
 // checkConsistency();
     return true;
 }
@@ -750,7 +751,7 @@ bool sprite_list::add(sprite *s)
         return false;
     }
     
-    containedUIDs[s->getUID()] = count;
+    addUID(s);
     sprites[count++]=s;
     //checkConsistency();
     return true;
@@ -759,17 +760,6 @@ bool sprite_list::add(sprite *s)
 bool sprite_list::remove(sprite *s)
 // removes pointer from list but doesn't delete it
 {
-    if(s==lastSpriteRequested)
-    {
-        lastUIDRequested=0;
-        lastSpriteRequested=0;
-    }
-    
-    map<long, int>::iterator it = containedUIDs.find(s->getUID());
-    
-    if(it != containedUIDs.end())
-        containedUIDs.erase(it);
-        
     int j=0;
     
     for(; j<count; j++)
@@ -780,12 +770,8 @@ bool sprite_list::remove(sprite *s)
     
 gotit:
 
-    for(int i=j; i<count-1; i++)
-    {
-        sprites[i]=sprites[i+1];
-        containedUIDs[sprites[i]->getUID()] = i;
-    }
-    
+    removeUID(s->getUID());
+    memmove(sprites+j, sprites+j+1, (count-j-1)*sizeof(sprite*));
     --count;
     //checkConsistency();
     return true;
@@ -836,25 +822,9 @@ bool sprite_list::del(int j)
     if(j<0||j>=count)
         return false;
         
-    map<long, int>::iterator it = containedUIDs.find(sprites[j]->getUID());
-    
-    if(it != containedUIDs.end())
-        containedUIDs.erase(it);
-    
-    if(sprites[j]==lastSpriteRequested)
-    {
-        lastUIDRequested=0;
-        lastSpriteRequested=0;
-    }
-    
+    removeUID(sprites[j]->getUID());
     delete sprites[j];
-    
-    for(int i=j; i<count-1; i++)
-    {
-        sprites[i]=sprites[i+1];
-        containedUIDs[sprites[i]->getUID()] = i;
-    }
-    
+    memmove(sprites+j, sprites+j+1, (count-j-1)*sizeof(sprite*));
     --count;
     //checkConsistency();
     return true;
@@ -1054,26 +1024,60 @@ int sprite_list::idLast(int id)
 
 sprite * sprite_list::getByUID(long uid)
 {
-    if(uid==lastUIDRequested)
-        return lastSpriteRequested;
+    for(int i=uid&(SLUIDHASH-1); uids[i].s; i=(i+1)&(SLUIDHASH-1))
+    {
+        if(uids[i].uid==uid)
+            return uids[i].s;
+    }
+    
+    return NULL;
+}
+
+void sprite_list::addUID(sprite *s)
+{
+    int i=s->getUID()&(SLUIDHASH-1);
     
-    map<long, int>::iterator it = containedUIDs.find(uid);
+    while(uids[i].s)
+        i=(i+1)&(SLUIDHASH-1);
+        
+    uids[i].uid=s->getUID();
+    uids[i].s=s;
+}
+
+void sprite_list::removeUID(long uid)
+{
+    int i=uid&(SLUIDHASH-1);
     
-    if(it != containedUIDs.end())
+    while(uids[i].s && uids[i].uid!=uid)
+        i=(i+1)&(SLUIDHASH-1);
+        
+    if(!uids[i].s)
+        return;
+        
+    // Pull later entries of the probe sequence back into the hole, unless
+    // that would put them before their home slot.
+    for(int j=(i+1)&(SLUIDHASH-1); uids[j].s; j=(j+1)&(SLUIDHASH-1))
     {
-        // Only update cache if requested sprite was found
-        lastUIDRequested=uid;
-        lastSpriteRequested=spr(it->second);
-        return lastSpriteRequested;
-    }
+        int home=uids[j].uid&(SLUIDHASH-1);
         
-    return NULL;
+        if(((j-home)&(SLUIDHASH-1)) >= ((j-i)&(SLUIDHASH-1)))
+        {
+            uids[i]=uids[j];
+            i=j;
+        }
+    }
+    
+    uids[i].s=NULL;
 }
 
 void sprite_list::checkConsistency()
 {
-    assert((int)containedUIDs.size() == count);
-    assert(lastUIDRequested==0 || containedUIDs.find(lastUIDRequested)!=containedUIDs.end());
+    int n=0;
+    
+    for(int i=0; i<SLUIDHASH; i++)
+        if(uids[i].s) ++n;
+        
+    assert(n == count);
     
     for(int i=0; i<count; i++)
         assert(sprites[i] == getByUID(sprites[i]->getUID()));
@@ -129,15 +129,21 @@ public:
 /**********************************/
 
 #define SLMAX 255
+#define SLUIDHASH 512 // power of two, at least twice SLMAX
 
 class sprite_list
 {
     sprite *sprites[SLMAX];
     int count;
-    map<long, int> containedUIDs;
-    // Cache requests from scripts
-    mutable long lastUIDRequested;
-    mutable sprite* lastSpriteRequested;
+    // Open addressing hash of the contained sprites by UID. It stores the
+    // sprite rather than its index, so removals don't have to touch it for
+    // every sprite that moves down.
+    struct uid_slot
+    {
+        long uid;
+        sprite *s;
+    };
+    uid_slot uids[SLUIDHASH];
     
 public:
     sprite_list();
@@ -178,6 +184,8 @@ public:
     
 private:
 
+    void addUID(sprite *s);
+    void removeUID(long uid);
     void checkConsistency(); //for debugging
 };
 
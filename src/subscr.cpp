@@ -3424,6 +3424,17 @@ FONT *ss_font(int fontnum)
     return tempfont;
 }
 
+// Whether ss_font() picks a font at random for this number. ssADOS has no case of its own.
+static bool ss_font_random(int fontnum)
+{
+    return fontnum<0 || fontnum>=ssfMAX || fontnum==ssADOS;
+}
+
+// Fonts picked by put_passive_subscr() for each object, so that drawing its cache twice
+// calls rand() no more often than drawing the subscreen once.
+static FONT *passive_subscr_fonts[MAXSUBSCREENITEMS];
+static bool passive_subscr_use_fonts = false;
+
 item *sel_a=NULL, *sel_b=NULL;
 
 
@@ -3494,7 +3505,7 @@ void show_custom_subscreen(BITMAP *dest, miscQdata *misc, subscreen_group *css,
         {
             FONT *tempfont=zfont;
             int fontnum=css->objects[i].d1;
-            tempfont=ss_font(fontnum);
+            tempfont=passive_subscr_use_fonts ? passive_subscr_fonts[i] : ss_font(fontnum);
             int x=css->objects[i].x+xofs;
             int y=css->objects[i].y+yofs;
             
@@ -4231,23 +4242,270 @@ void minimaptitle(BITMAP *dest, int x, int y, FONT *tempfont, int color, int sha
     }
 }
 
+// The passive subscreen is only redrawn when something it shows may have changed; otherwise
+// the last drawing is copied. It's kept twice, drawn over colour 0 and over colour 255: where
+// the two agree the subscreen drew that pixel, and where they differ it left the background.
+static BITMAP *passive_subscr_cache[2] = { NULL, NULL };
+static subscreen_group *passive_subscr_css = NULL;
+static bool passive_subscr_cacheable = false;
+static bool passive_subscr_timed = false;
+static bool passive_subscr_valid = false;
+static dword passive_subscr_hash = 0;
+
+void invalidate_passive_subscr()
+{
+    passive_subscr_css = NULL;
+    passive_subscr_valid = false;
+}
+
+// Objects that draw translucently depend on what's under them, and those using random tiles,
+// colours or fonts look different every frame. Selectors and the large map depend on more
+// than passive_subscr_state() looks at.
+static bool volatile_subscreen_object(const subscreen_object &o)
+{
+    switch(o.type)
+    {
+    case ssoBSTIME:
+    case ssoSSTIME:
+    case ssoTIME:
+    case ssoTEXT:
+    case ssoCOUNTERS:
+    case ssoCOUNTER:
+    case ssoMINIMAPTITLE:
+    case ssoTEXTBOX:
+    case ssoSELECTEDITEMNAME:
+        if(ss_font_random(o.d1))
+            return true;
+            
+        break;
+        
+
+    case ssoLIFEGAUGE:
+    case ssoMAGICGAUGE:
+    case ssoSELECTOR1:
+    case ssoSELECTOR2:
+    case ssoLARGEMAP:
+        return true;
+        
+    case ssoLINE:
+    case sso2X2FRAME:
+    case ssoTILEBLOCK:
+    case ssoTRIFORCE:
+        if(o.d4)
+            return true;
+            
+        break;
+        
+    case ssoRECT:
+    case ssoBUTTONITEM:
+        if(o.d2)
+            return true;
+            
+        break;
+        
+    case ssoMINITILE:
+        if(o.d6 || (o.d1==-1 && o.d2!=ssmstSSVINETILE && o.d2!=ssmstMAGICMETER))
+            return true;
+            
+        break;
+    }
+    
+    const int types[3] = { o.colortype1, o.colortype2, o.colortype3 };
+    const int colors[3] = { o.color1, o.color2, o.color3 };
+    
+    for(int i=0; i<3; ++i)
+    {
+        if(types[i]==ssctMISC && (colors[i]<ssctTEXT || colors[i]>ssctLINKDOT))
+            return true;
+    }
+    
+    // See subscreen_cset()
+    if((o.type==sso2X2FRAME || o.type==ssoTILEBLOCK || o.type==ssoTRIFORCE || o.type==ssoMINITILE) &&
+            o.colortype1==ssctMISC && o.color1!=sscsTRIFORCECSET)
+        return true;
+        
+    return false;
+}
+
+static void analyse_passive_subscr(subscreen_group *css)
+{
+    passive_subscr_css = css;
+    passive_subscr_cacheable = true;
+    passive_subscr_timed = false;
+    passive_subscr_valid = false;
+    
+    for(int i=0; i<MAXSUBSCREENITEMS&&css->objects[i].type>ssoNULL; ++i)
+    {
+        if(volatile_subscreen_object(css->objects[i]))
+            passive_subscr_cacheable = false;
+            
+        if(css->objects[i].type==ssoBSTIME || css->objects[i].type==ssoSSTIME || css->objects[i].type==ssoTIME)
+            passive_subscr_timed = true;
+    }
+}
+
+static inline void hash_bytes(dword &h, const void *data, size_t size)
+{
+    const byte *p = (const byte *)data;
+    
+    for(size_t i=0; i<size; ++i)
+    {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+}
+
+static bool hash_subscreen_sprite(dword &h, sprite *s)
+{
+    item *it = (item *)s;
+    
+    if(it->drawstyle!=0 && it->drawstyle!=3)
+        return false;
+        
+    int fields[] =
+    {
+        it->id, it->tile, it->cs, it->flip, it->drawstyle, it->extend, it->misc, it->clk>=0,
+        it->txsz, it->tysz, it->xofs.v, it->yofs.v, it->zofs.v, it->z.v, it->pickup, (it->pickup&ipFADE) ? fadeclk : 0, it->clk2,
+        it->dummy_bool[0]
+    };
+    hash_bytes(h, fields, sizeof(fields));
+    return true;
+}
+
+// Hashes everything the cacheable objects read. Returns false if one of the items shown is
+// drawn translucently or cloaked, so can't be cached.
+static bool passive_subscr_state(dword &h, miscQdata *misc, bool showtime, int pos2)
+{
+    h = 2166136261u;
+    
+    int dmap = get_currdmap();
+    int view[] =
+    {
+        showtime, pos2, passive_subscreen_height, dmap, get_currscr(), get_homescr(), get_dlevel(),
+        frame&16, Awpn, Bwpn, Bpos, Aid, Bid, show_subscreen_dmap_dots, show_subscreen_numbers,
+        show_subscreen_items, show_subscreen_life, show_sprites, Lwpns.idCount(wLitBomb),
+        Lwpns.idCount(wLitSBomb), passive_subscr_timed ? int(game->get_time()/60) : 0,
+        TheMaps[(DMaps[dmap].map*MAPSCRS)+get_homescr()].flags7
+    };
+    hash_bytes(h, view, sizeof(view));
+    hash_bytes(h, &passive_subscr_css, sizeof(passive_subscr_css));
+    hash_bytes(h, &misc->colors, sizeof(misc->colors));
+    hash_bytes(h, &DMaps[dmap], sizeof(DMaps[dmap]));
+    hash_bytes(h, quest_rules, sizeof(quest_rules));
+    
+    hash_bytes(h, game->item, sizeof(game->item));
+    hash_bytes(h, game->items_off, sizeof(game->items_off));
+    hash_bytes(h, game->_maxcounter, sizeof(game->_maxcounter));
+    hash_bytes(h, game->_counter, sizeof(game->_counter));
+    hash_bytes(h, game->_dcounter, sizeof(game->_dcounter));
+    hash_bytes(h, game->lvlitems, sizeof(game->lvlitems));
+    hash_bytes(h, game->lvlkeys, sizeof(game->lvlkeys));
+    hash_bytes(h, game->_generic, sizeof(game->_generic));
+    hash_bytes(h, game->bmaps+dmap*64, 64);
+    
+    for(int i=0; i<MAXITEMS; ++i)
+    {
+        long fields[] = { itemsbuf[i].power, itemsbuf[i].flags, itemsbuf[i].misc1 };
+        hash_bytes(h, fields, sizeof(fields));
+    }
+    
+    for(int i=0; i<Sitems.Count(); ++i)
+    {
+        if(!hash_subscreen_sprite(h, Sitems.spr(i)))
+            return false;
+    }
+    
+    if(Aitem && !hash_subscreen_sprite(h, Aitem))
+        return false;
+        
+    if(Bitem && !hash_subscreen_sprite(h, Bitem))
+        return false;
+        
+    return true;
+}
+
+static void draw_passive_subscr_cache(BITMAP *dest, int x, int y)
+{
+    int w = zc_min(256, dest->w-x);
+    int h = zc_min(passive_subscreen_height, dest->h-y);
+    
+    for(int j=0; j<h; ++j)
+    {
+        byte *d = dest->line[y+j]+x;
+        const byte *a = passive_subscr_cache[0]->line[j];
+        const byte *b = passive_subscr_cache[1]->line[j];
+        
+        for(int i=0; i<w; ++i)
+        {
+            if(a[i]==b[i])
+                d[i]=a[i];
+        }
+    }
+}
+
 void put_passive_subscr(BITMAP *dest,miscQdata *misc,int x,int y,bool showtime,int pos2)
 {
     // uncomment this?
     //  load_Sitems();
     Sitems.animate();
     update_subscr_items();
-    BITMAP *subscr = create_sub_bitmap(dest,x,y,256,passive_subscreen_height);
     
     if(no_subscreen())
     {
+        BITMAP *subscr = create_sub_bitmap(dest,x,y,256,passive_subscreen_height);
         clear_to_color(subscr,0);
         destroy_bitmap(subscr);
         return;
     }
     
-    show_custom_subscreen(subscr, misc, current_subscreen_passive, 0, 0, showtime, pos2);
-    destroy_bitmap(subscr);
+    if(passive_subscr_css != current_subscreen_passive)
+        analyse_passive_subscr(current_subscreen_passive);
+        
+    dword hash = 0;
+    
+    if(!passive_subscr_cacheable || !game || x<0 || y<0 || !is_memory_bitmap(dest) || bitmap_color_depth(dest)!=8 ||
+            !passive_subscr_state(hash, misc, showtime, pos2))
+    {
+        BITMAP *subscr = create_sub_bitmap(dest,x,y,256,passive_subscreen_height);
+        show_custom_subscreen(subscr, misc, current_subscreen_passive, 0, 0, showtime, pos2);
+        destroy_bitmap(subscr);
+        return;
+    }
+    
+    // show_custom_subscreen() calls ss_font() for every object, and for objects that don't
+    // use a font that can still call rand(). Do the same here, once, whether or not the cache
+    // is redrawn, so the game's other uses of rand() see the same sequence either way.
+    for(int i=0; i<MAXSUBSCREENITEMS&&current_subscreen_passive->objects[i].type>ssoNULL; ++i)
+    {
+        if((current_subscreen_passive->objects[i].pos & pos2) != 0)
+            passive_subscr_fonts[i]=ss_font(current_subscreen_passive->objects[i].d1);
+    }
+    
+    if(!passive_subscr_valid || hash != passive_subscr_hash)
+    {
+        passive_subscr_use_fonts = true;
+        
+        for(int i=0; i<2; ++i)
+        {
+            if(passive_subscr_cache[i] && passive_subscr_cache[i]->h != passive_subscreen_height)
+            {
+                destroy_bitmap(passive_subscr_cache[i]);
+                passive_subscr_cache[i] = NULL;
+            }
+            
+            if(!passive_subscr_cache[i])
+                passive_subscr_cache[i] = create_bitmap_ex(8,256,passive_subscreen_height);
+                
+            clear_to_color(passive_subscr_cache[i], i ? 255 : 0);
+            show_custom_subscreen(passive_subscr_cache[i], misc, current_subscreen_passive, 0, 0, showtime, pos2);
+        }
+        
+        passive_subscr_use_fonts = false;
+        passive_subscr_hash = hash;
+        passive_subscr_valid = true;
+    }
+    
+    draw_passive_subscr_cache(dest, x, y);
 }
 
 /*
@@ -4591,6 +4849,7 @@ void putBmap(BITMAP *dest, miscQdata *misc, int x, int y,bool showmap, bool show
 void load_Sitems(miscQdata *misc)
 {
     Sitems.clear();
+    invalidate_passive_subscr();
     
     // HC Pieces
     if(misc->colors.new_HCpieces_tile)
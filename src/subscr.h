@@ -298,6 +298,8 @@ void update_subscr_items();
 void add_subscr_item(item *newItem);
 int stripspaces(char *source, char *target, int stop);
 void put_passive_subscr(BITMAP *dest,miscQdata *misc,int x,int y,bool showtime,int pos2);
+// Forces the next put_passive_subscr() to redraw, for changes it can't see (eg. tile edits).
+void invalidate_passive_subscr();
 void puttriframe(BITMAP *dest, miscQdata *misc, int x, int y, int triframecolor, int numbercolor, int triframetile, int triframecset, int triforcetile, int triforcecset, bool showframe, bool showpieces, bool largepieces);
 void puttriforce(BITMAP *dest, miscQdata *misc, int x, int y, int tile, int cset, int w, int h, int flip, bool overlay, bool trans, int trinum);
 void draw_block(BITMAP *dest,int x,int y,int tile,int cset,int w,int h);
@@ -14,6 +14,13 @@
 
 #include "zc_alleg.h"
 #include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TILES_SSE2
+#include <emmintrin.h>
+#endif
 
 #include "zdefs.h"
 #include "zsys.h"
@@ -30,10 +37,10 @@ extern byte        quest_rules[QUESTRULES_SIZE];
 tiledata *newtilebuf, *grabtilebuf;
 newcombo *combobuf;
 word animated_combo_table[MAXCOMBOS][2];                    //[0]=position in act2, [1]=original tile
-word animated_combo_table4[MAXCOMBOS][2];                   //[0]=combo, [1]=clock
+word animated_combo_table4[MAXCOMBOS][2];                   //[0]=combo, [1]=frame the clock was reset
 word animated_combos;
 word animated_combo_table2[MAXCOMBOS][2];                    //[0]=position in act2, [1]=original tile
-word animated_combo_table24[MAXCOMBOS][2];                   //[0]=combo, [1]=clock
+word animated_combo_table24[MAXCOMBOS][2];                   //[0]=combo, [1]=frame the clock was reset
 word animated_combos2;
 bool blank_tile_table[NEWMAXTILES];                         //keeps track of blank tiles
 bool used_tile_table[NEWMAXTILES];                          //keeps track of used tiles
@@ -163,6 +170,124 @@ word count_combos()
     return combos_used;
 }
 
+// The combo animations are kept on a timing wheel with a slot per frame,
+// modulo 256 since speed is a byte, so that each frame only the combos
+// whose tile changes are looked at. Rather than counting every frame, each
+// entry's clock is the number of frames since the one stored in [1].
+#define ANIM_WHEEL_SIZE 256
+
+static word anim_tick = 0;
+static std::vector<word> anim_wheel[2][ANIM_WHEEL_SIZE];
+static word anim_due[2][MAXCOMBOS];                         //frame each entry's tile changes
+
+static inline word (*anim_table(int t))[2]
+{
+    return t ? animated_combo_table24 : animated_combo_table4;
+}
+
+static inline word anim_count(int t)
+{
+    return t ? animated_combos2 : animated_combos;
+}
+
+// An entry whose clock is already past its speed, because the speed was lowered, is due on
+// the next call to animate_combos(), as it would have been when every clock was checked.
+static void schedule_combo_animation(int t, int x)
+{
+    word (*table)[2] = anim_table(t);
+    short clock = (short)(word)(anim_tick - table[x][1]);
+    word speed = combobuf[table[x][0]].speed;
+    word due = clock >= speed ? anim_tick : word(table[x][1] + speed);
+    anim_due[t][x] = due;
+    anim_wheel[t][due % ANIM_WHEEL_SIZE].push_back(x);
+}
+
+static void reset_combo_animation_clock(int t, int x)
+{
+    if(x >= anim_count(t))
+        return;
+        
+    anim_table(t)[x][1] = anim_tick;
+    schedule_combo_animation(t, x);
+}
+
+static void schedule_combo_animations(int t)
+{
+    for(int i=0; i<ANIM_WHEEL_SIZE; ++i)
+    {
+        anim_wheel[t][i].clear();
+    }
+    
+    for(word x=0; x<anim_count(t); ++x)
+    {
+        schedule_combo_animation(t, x);
+    }
+}
+
+// Whether entry x is on the current frame's slot because its clock has
+// reached its speed, and not left over from before its clock was reset.
+static inline bool combo_animation_due(int t, int x)
+{
+    return x < anim_count(t) && anim_due[t][x] == anim_tick;
+}
+
+// Entries past the end of the table never run, so their clocks stay at 0.
+word combo_animation_clock(int x)
+{
+    return x < animated_combos ? anim_tick - animated_combo_table4[x][1] : 0;
+}
+
+word combo_animation_clock2(int x)
+{
+    return x < animated_combos2 ? anim_tick - animated_combo_table24[x][1] : 0;
+}
+
+void reset_combo_animation_clock(int x)
+{
+    reset_combo_animation_clock(0, x);
+}
+
+void reset_combo_animation_clock2(int x)
+{
+    reset_combo_animation_clock(1, x);
+}
+
+void reschedule_combo_animation(int c)
+{
+    if(c < 0 || c >= MAXCOMBOS)
+        return;
+        
+    for(int t=0; t<2; ++t)
+    {
+        int x = (t ? animated_combo_table2 : animated_combo_table)[c][0];
+        
+        // Entries left on their old slot are skipped there, as their due frame no longer matches.
+        if(x < anim_count(t) && anim_table(t)[x][0] == c)
+            schedule_combo_animation(t, x);
+    }
+}
+
+const std::vector<word> &combo_animations_due(bool fresh)
+{
+    static std::vector<word> due[2];
+    int t = fresh ? 1 : 0;
+    std::vector<word> &slot = anim_wheel[t][anim_tick % ANIM_WHEEL_SIZE];
+    
+    due[t].clear();
+    
+    for(size_t i=0; i<slot.size(); ++i)
+    {
+        int x = slot[i];
+        
+        if(combo_animation_due(t, x) && (word)(anim_tick - anim_table(t)[x][1]) >= combobuf[anim_table(t)[x][0]].speed)
+        {
+            due[t].push_back(anim_table(t)[x][0]);
+        }
+    }
+    
+    return due[t];
+}
+
 void setup_combo_animations()
 {
     memset(animated_combo_table, 0, MAXCOMBOS*2*2);
@@ -177,12 +302,13 @@ void setup_combo_animations()
         if((combobuf[x].frames>1 || combobuf[x].nextcombo != 0)&&!(combobuf[x].animflags &	AF_FRESH))
         {
             animated_combo_table4[y][0]=x;
-            animated_combo_table4[y][1]=0;
+            animated_combo_table4[y][1]=anim_tick;
             ++y;
         }
     }
     
     animated_combos=y;
+    schedule_combo_animations(0);
 }
 
 void setup_combo_animations2()
@@ -199,12 +325,13 @@ void setup_combo_animations2()
         if((combobuf[x].frames>1 || combobuf[x].nextcombo != 0)&&combobuf[x].animflags & AF_FRESH)
         {
             animated_combo_table24[y][0]=x;
-            animated_combo_table24[y][1]=0;
+            animated_combo_table24[y][1]=anim_tick;
             ++y;
         }
     }
     
     animated_combos2=y;
+    schedule_combo_animations(1);
 }
 
 void reset_combo_animation(int c)
@@ -216,7 +343,7 @@ void reset_combo_animation(int c)
         if(y==c)
         {
             combobuf[y].tile=animated_combo_table[y][1];        //reset tile
-            animated_combo_table4[x][1]=0;                        //reset clock
+            reset_combo_animation_clock(0, x);                  //reset clock
             return;
         }
     }
@@ -231,7 +358,7 @@ void reset_combo_animation2(int c)
         if(y==c)
         {
             combobuf[y].tile=animated_combo_table2[y][1];        //reset tile
-            animated_combo_table24[x][1]=0;                        //reset clock
+            reset_combo_animation_clock(1, x);                   //reset clock
             return;
         }
     }
@@ -253,74 +380,67 @@ void reset_combo_animations2()
     }
 }
 
-extern void update_combo_cycling();
-
-void animate_combos()
+// Advances the tiles of the entries whose clocks reach their speed this
+// frame, and puts them back on the wheel.
+static void animate_combo_wheel(int t)
 {
-    update_combo_cycling();
+    static std::vector<word> slot;
+    word (*table)[2] = anim_table(t);
+    word (*orig)[2] = t ? animated_combo_table2 : animated_combo_table;
     
-    for(word x=0; x<animated_combos; ++x)
+    // An entry with a speed of 255 goes back on the slot it came from.
+    slot.clear();
+    slot.swap(anim_wheel[t][anim_tick % ANIM_WHEEL_SIZE]);
+    
+    for(size_t i=0; i<slot.size(); ++i)
     {
-        int y=animated_combo_table4[x][0];                      //combo number
+        int x=slot[i];
         
-        if(animated_combo_table4[x][1]>=combobuf[y].speed)      //time to animate
-        {
-            //this is a mess.
-            if(combobuf[y].tile-
-                    (combobuf[y].frames+((combobuf[y].frames-1)*combobuf[y].skipanim)+
-                     (combobuf[y].skipanimy*TILES_PER_ROW))
-                    >=animated_combo_table[y][1]-1)
-            {
-                combobuf[y].tile=animated_combo_table[y][1];        //reset tile
-            }
-            else
-            {
-                int temp=combobuf[y].tile;
-                combobuf[y].tile+=1+(combobuf[y].skipanim); //increment tile
-                
-                if(temp/TILES_PER_ROW!=combobuf[y].tile/TILES_PER_ROW)
-                    combobuf[y].tile+=TILES_PER_ROW*combobuf[y].skipanimy;
-            }
+        if(!combo_animation_due(t, x))
+            continue;
             
-            animated_combo_table4[x][1]=0;                        //reset clock
-        }
-        else
+        int y=table[x][0];                                      //combo number
+        
+        // The speed went up since this was scheduled.
+        if((word)(anim_tick - table[x][1]) < combobuf[y].speed)
         {
-            ++animated_combo_table4[x][1];                        //increment clock
+            schedule_combo_animation(t, x);
+            continue;
         }
-    }
-    
-    for(word x=0; x<animated_combos2; ++x)
-    {
-        int y=animated_combo_table24[x][0];                      //combo number
         
-        if(animated_combo_table24[x][1]>=combobuf[y].speed)      //time to animate
+        //this is a mess.
+        if(combobuf[y].tile-
+                (combobuf[y].frames+((combobuf[y].frames-1)*combobuf[y].skipanim)+
+                 (t ? (combobuf[y].frames-1)*combobuf[y].skipanimy*TILES_PER_ROW
+                  : combobuf[y].skipanimy*TILES_PER_ROW))
+                >=orig[y][1]-1)
         {
-            if(combobuf[y].tile-
-                    (combobuf[y].frames+((combobuf[y].frames-1)*combobuf[y].skipanim)+
-                     (combobuf[y].frames-1)*combobuf[y].skipanimy*TILES_PER_ROW)
-                    >=animated_combo_table2[y][1]-1)
-            {
-                combobuf[y].tile=animated_combo_table2[y][1];        //reset tile
-            }
-            else
-            {
-                int temp=combobuf[y].tile;
-                combobuf[y].tile+=1+(combobuf[y].skipanim); //increment tile
-                
-                if(temp/TILES_PER_ROW!=combobuf[y].tile/TILES_PER_ROW)
-                    combobuf[y].tile+=TILES_PER_ROW*combobuf[y].skipanimy;
-            }
-            
-            animated_combo_table24[x][1]=0;                        //reset clock
+            combobuf[y].tile=orig[y][1];                        //reset tile
         }
         else
         {
-            ++animated_combo_table24[x][1];                        //increment clock
+            int temp=combobuf[y].tile;
+            combobuf[y].tile+=1+(combobuf[y].skipanim); //increment tile
+            
+            if(temp/TILES_PER_ROW!=combobuf[y].tile/TILES_PER_ROW)
+                combobuf[y].tile+=TILES_PER_ROW*combobuf[y].skipanimy;
         }
+        
+        table[x][1]=anim_tick+1;                                //reset clock
+        schedule_combo_animation(t, x);
     }
 }
 
+extern void update_combo_cycling();
+
+void animate_combos()
+{
+    update_combo_cycling();
+    animate_combo_wheel(0);
+    animate_combo_wheel(1);
+    ++anim_tick;
+}
+
 /*
 bool isonline(float x1, float y1, float x2, float y2, float x3, float y3)
 {
@@ -397,6 +517,11 @@ void clear_tile(tiledata *buf, word tile)
 
 void reset_tile(tiledata *buf, int t, int format=1)
 {
+    if(buf==newtilebuf)
+    {
+        invalidate_tile_cache(t);
+    }
+    
     buf[t].format=format;
     
     if(buf[t].data!=NULL)
@@ -534,13 +659,115 @@ bool copy_tile(tiledata *buf, int src, int dest, bool swap)
 }
 
 
+// Recently unpacked tiles from newtilebuf, keyed by tile, flip&5 and the
+// tile's data pointer. The cache is 4-way set associative with LRU
+// replacement inside each set. ZQuest writes tile data directly in too
+// many places to keep it coherent, so only ZC turns it on.
+#define TILE_CACHE_SETS 256
+#define TILE_CACHE_WAYS 4
+
+struct unpacked_tile
+{
+    byte *data;
+    int tile;
+    int flip;
+    dword last_used;
+    byte pixels[256];
+};
+
+bool cache_unpacked_tiles=false;
+static unpacked_tile *tile_cache=NULL;
+static dword tile_cache_clock=0;
+
+// The tile currently in unpackbuf
+static byte *oldnewtilebuf=NULL;
+static int oldtile=-5, oldflip=-5;
+
+static INLINE int tile_cache_set(int tile, int flip)
+{
+    return ((tile<<2)|(flip&1)|((flip&4)>>1))&(TILE_CACHE_SETS-1);
+}
+
+void clear_tile_cache()
+{
+    if(tile_cache)
+    {
+        memset(tile_cache, 0, TILE_CACHE_SETS*TILE_CACHE_WAYS*sizeof(unpacked_tile));
+    }
+    
+    oldtile=-5;
+}
+
+void invalidate_tile_cache(int tile)
+{
+    if(tile==oldtile)
+    {
+        oldtile=-5;
+    }
+    
+    if(!tile_cache)
+    {
+        return;
+    }
+    
+    for(int f=0; f<4; ++f)
+    {
+        unpacked_tile *set=tile_cache+tile_cache_set(tile, (f&1)|((f&2)<<1))*TILE_CACHE_WAYS;
+        
+        for(int w=0; w<TILE_CACHE_WAYS; ++w)
+        {
+            if(set[w].data && set[w].tile==tile)
+            {
+                set[w].data=NULL;
+            }
+        }
+    }
+}
+
+// Returns the cache entry holding the tile, or the entry to replace with it.
+static unpacked_tile *find_unpacked_tile(byte *data, int tile, int flip)
+{
+    if(!tile_cache)
+    {
+        tile_cache=(unpacked_tile*)zc_malloc(TILE_CACHE_SETS*TILE_CACHE_WAYS*sizeof(unpacked_tile));
+        
+        if(!tile_cache)
+        {
+            cache_unpacked_tiles=false;
+            return NULL;
+        }
+        
+        memset(tile_cache, 0, TILE_CACHE_SETS*TILE_CACHE_WAYS*sizeof(unpacked_tile));
+    }
+    
+    unpacked_tile *set=tile_cache+tile_cache_set(tile, flip)*TILE_CACHE_WAYS;
+    unpacked_tile *victim=set;
+    
+    for(int w=0; w<TILE_CACHE_WAYS; ++w)
+    {
+        if(set[w].data==data && set[w].tile==tile && set[w].flip==flip)
+        {
+            return set+w;
+        }
+        
+        if(!set[w].data)
+        {
+            victim=set+w;
+        }
+        else if(victim->data && set[w].last_used<victim->last_used)
+        {
+            victim=set+w;
+        }
+    }
+    
+    return victim;
+}
+
+static void expand_tile(tiledata *buf, int tile, int flip);
+
 // unpacks from tilebuf to unpackbuf
 void unpack_tile(tiledata *buf, int tile, int flip, bool force)
 {
-    static byte *si, *di;
-    static byte *oldnewtilebuf=buf[tile].data;
-    static int i, j, oldtile=-5, oldflip=-5;
-    
     if(tile==oldtile&&(flip&5)==(oldflip&5)&&oldnewtilebuf==buf[tile].data&&!force)
     {
         return;
@@ -550,6 +777,37 @@ void unpack_tile(tiledata *buf, int tile, int flip, bool force)
     oldflip=flip;
     oldnewtilebuf=buf[tile].data;
     
+    unpacked_tile *cached=NULL;
+    
+    if(cache_unpacked_tiles && buf==newtilebuf)
+    {
+        cached=find_unpacked_tile(buf[tile].data, tile, flip&5);
+        
+        if(cached && cached->data==buf[tile].data && cached->tile==tile && cached->flip==(flip&5) && !force)
+        {
+            memcpy(unpackbuf, cached->pixels, 256);
+            cached->last_used=++tile_cache_clock;
+            return;
+        }
+    }
+    
+    expand_tile(buf, tile, flip);
+    
+    if(cached)
+    {
+        cached->data=buf[tile].data;
+        cached->tile=tile;
+        cached->flip=flip&5;
+        cached->last_used=++tile_cache_clock;
+        memcpy(cached->pixels, unpackbuf, 256);
+    }
+}
+
+static void expand_tile(tiledata *buf, int tile, int flip)
+{
+    static byte *si, *di;
+    static int i, j;
+    
     switch(flip&5)
     {
     case 1:  //horizontal
@@ -730,6 +988,11 @@ void unpack_tile(tiledata *buf, int tile, int flip, bool force)
 // packs from src[256] to tilebuf
 void pack_tile(tiledata *buf, byte *src,int tile)
 {
+    if(buf==newtilebuf)
+    {
+        invalidate_tile_cache(tile);
+    }
+    
     pack_tiledata(buf[tile].data, src, buf[tile].format);
 }
 
@@ -2560,6 +2823,142 @@ void overcombo2(BITMAP* dest,int x,int y,int cmbdat,int cset)
     }
 }
 
+// Copies the tile in unpackbuf to a spot entirely inside dest, 16 pixels per row.
+// 'cset' is already shifted; zero pixels are skipped if 'transparent' is set.
+static void blit_unpacked_tile16(BITMAP* dest,int x,int y,int cset,bool vflip,bool transparent)
+{
+#ifdef TILES_SSE2
+    const __m128i vcset = _mm_set1_epi8((char)cset);
+    const __m128i zero = _mm_setzero_si128();
+    
+    for(int dy=0; dy<16; ++dy)
+    {
+        const __m128i src = _mm_loadu_si128((const __m128i*)(unpackbuf + ((vflip ? 15-dy : dy)<<4)));
+        __m128i *di = (__m128i*)(dest->line[y+dy]+x);
+        __m128i pixels = _mm_add_epi8(src, vcset);
+        
+        if(transparent)
+        {
+            const __m128i mask = _mm_cmpeq_epi8(src, zero);
+            pixels = _mm_or_si128(_mm_and_si128(mask, _mm_loadu_si128(di)), _mm_andnot_si128(mask, pixels));
+        }
+        
+        _mm_storeu_si128(di, pixels);
+    }
+    
+#else
+    
+    for(int dy=0; dy<16; ++dy)
+    {
+        byte *si = unpackbuf + ((vflip ? 15-dy : dy)<<4);
+        byte *di = dest->line[y+dy]+x;
+        
+        for(int dx=0; dx<16; ++dx)
+        {
+            if(!transparent || si[dx])
+                di[dx] = si[dx] + cset;
+        }
+    }
+    
+#endif
+}
+
+static bool tile_blit_order(const tile_blit &a, const tile_blit &b)
+{
+    if(a.tile != b.tile)
+        return a.tile < b.tile;
+        
+    return (a.flip&5) < (b.flip&5);
+}
+
+void blit_tile_batch(BITMAP* dest,tile_blit *blits,int count,bool transparent,bool overlapping)
+{
+    // Tiles that can't overlap may be drawn in any order, so draw each
+    // distinct tile and rotation together and only unpack it once.
+    if(!overlapping)
+        std::sort(blits, blits+count, tile_blit_order);
+        
+    for(int i=0; i<count; ++i)
+    {
+        const tile_blit &b = blits[i];
+        
+        if(b.opacity < 128)
+        {
+            if(transparent)
+                overtiletranslucent16(dest,b.tile,b.x,b.y,b.cset,b.flip,b.opacity);
+            else
+                puttiletranslucent16(dest,b.tile,b.x,b.y,b.cset,b.flip,b.opacity);
+                
+            continue;
+        }
+        
+        // Clipped and invalid tiles take the regular path.
+        if(b.tile<0 || b.tile>=NEWMAXTILES || b.x<0 || b.y<0 || b.x+16>dest->w || b.y+16>dest->h || !is_memory_bitmap(dest))
+        {
+            if(transparent)
+                overtile16(dest,b.tile,b.x,b.y,b.cset,b.flip);
+            else
+                puttile16(dest,b.tile,b.x,b.y,b.cset,b.flip);
+                
+            continue;
+        }
+        
+        if(transparent && blank_tile_table[b.tile])
+            continue;
+            
+        int cset = newtilebuf[b.tile].format>tf4Bit ? 0 : b.cset;
+        cset &= 15;
+        cset <<= CSET_SHFT;
+        unpack_tile(newtilebuf, b.tile, b.flip&5, false);
+        blit_unpacked_tile16(dest,b.x,b.y,cset,(b.flip&2)!=0,transparent);
+    }
+}
+
+static void draw_combo_grid(BITMAP* dest,int x,int y,const std::vector<word> &cmbdat,const std::vector<byte> &cset,bool transparent)
+{
+    static tile_blit blits[176];
+    int count=0;
+    
+    for(int i=0; i<176; ++i)
+    {
+        const newcombo &c = combobuf[cmbdat[i]];
+        const int cx=((i&15)<<4)+x;
+        const int cy=(i&0xF0)+y;
+        const int drawtile=combo_tile(c, cx, cy);
+        
+        // Combos with per-quarter csets are drawn in 8x8 blocks.
+        if((c.csets&0xF0) && (c.csets&0x0F) && drawtile>=0 && drawtile<NEWMAXTILES && newtilebuf[drawtile].format<=tf4Bit)
+        {
+            if(transparent)
+                overcombo(dest,cx,cy,cmbdat[i],cset[i]);
+            else
+                putcombo(dest,cx,cy,cmbdat[i],cset[i]);
+                
+            continue;
+        }
+        
+        tile_blit &b = blits[count++];
+        b.tile=drawtile;
+        b.x=cx;
+        b.y=cy;
+        b.cset=cset[i];
+        b.flip=c.flip;
+        b.opacity=255;
+    }
+    
+    blit_tile_batch(dest,blits,count,transparent,false);
+}
+
+void putcombo_grid(BITMAP* dest,int x,int y,const std::vector<word> &cmbdat,const std::vector<byte> &cset)
+{
+    draw_combo_grid(dest,x,y,cmbdat,cset,false);
+}
+
+void overcombo_grid(BITMAP* dest,int x,int y,const std::vector<word> &cmbdat,const std::vector<byte> &cset)
+{
+    draw_combo_grid(dest,x,y,cmbdat,cset,true);
+}
+
 bool is_valid_format(byte format)
 {
     switch(format)
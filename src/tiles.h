@@ -15,6 +15,7 @@
 
 #define UNPACKSIZE 256
 
+#include <vector>
 #include "zc_alleg.h"
 #include "zdefs.h"
 
@@ -22,10 +23,10 @@
 extern tiledata *newtilebuf, *grabtilebuf;
 extern newcombo *combobuf;
 extern word animated_combo_table[MAXCOMBOS][2];             //[0]=position in act2, [1]=original tile
-extern word animated_combo_table4[MAXCOMBOS][2];            //[0]=combo, [1]=clock
+extern word animated_combo_table4[MAXCOMBOS][2];            //[0]=combo, [1]=frame the clock was reset
 extern word animated_combos;
 extern word animated_combo_table2[MAXCOMBOS][2];             //[0]=position in act2, [1]=original tile
-extern word animated_combo_table24[MAXCOMBOS][2];            //[0]=combo, [1]=clock
+extern word animated_combo_table24[MAXCOMBOS][2];            //[0]=combo, [1]=frame the clock was reset
 extern word animated_combos2;
 extern bool blank_tile_table[NEWMAXTILES];                  //keeps track of blank tiles
 extern bool used_tile_table[NEWMAXTILES];                   //keeps track of used tiles
@@ -46,6 +47,16 @@ void reset_combo_animations();
 void setup_combo_animations2();
 void reset_combo_animation2(int c);
 void reset_combo_animations2();
+// Frames since the clock of animated_combo_table4/24 entry x was reset.
+word combo_animation_clock(int x);
+word combo_animation_clock2(int x);
+void reset_combo_animation_clock(int x);
+void reset_combo_animation_clock2(int x);
+// Call when combo c's speed changes, so that it animates when its clock reaches the new speed.
+void reschedule_combo_animation(int c);
+// The combos whose clocks reach their speed this frame; a combo whose clock
+// was reset this frame may be listed twice.
+const std::vector<word> &combo_animations_due(bool fresh);
 void animate_combos();
 bool isonline(long x1, long y1, long x2, long y2, long x3, long y3);
 void reset_tile(tiledata *buf, int t, int format);
@@ -55,6 +66,13 @@ void overlay_tile(tiledata *buf,int dest,int src,int cs,bool backwards);
 bool copy_tile(tiledata *buf, int src, int dest, bool swap);
 void unpack_tile(tiledata *buf, int tile, int flip, bool force);
 
+// Keeps recently unpacked newtilebuf tiles around so redrawing them skips
+// the unpack. Anything that writes tile data without going through
+// pack_tile() or reset_tile() must invalidate the tile.
+extern bool cache_unpacked_tiles;
+void clear_tile_cache();
+void invalidate_tile_cache(int tile);
+
 void pack_tile(tiledata *buf, byte *src,int tile);
 void pack_tiledata(byte *dest, byte *src, byte format);
 void pack_tiles(byte *buf);
@@ -80,6 +98,20 @@ void overcombo(BITMAP* dest,int x,int y,int cmbdat,int cset);
 void overcomboblock(BITMAP *dest, int x, int y, int cmbdat, int cset, int w, int h);
 void overcombo2(BITMAP* dest,int x,int y,int cmbdat,int cset);
 
+// One 16x16 tile for blit_tile_batch().
+struct tile_blit
+{
+    int tile, x, y, cset, flip, opacity;
+};
+
+// Draws a list of tiles as puttile16()/overtile16() would (or their
+// translucent versions, for opacity < 128). Unless 'overlapping' is set the
+// list is reordered to group identical tiles together.
+void blit_tile_batch(BITMAP* dest,tile_blit *blits,int count,bool transparent,bool overlapping);
+// Draws a screen's 176 combos with their top left corner at x,y.
+void putcombo_grid(BITMAP* dest,int x,int y,const std::vector<word> &cmbdat,const std::vector<byte> &cset);
+void overcombo_grid(BITMAP* dest,int x,int y,const std::vector<word> &cmbdat,const std::vector<byte> &cset);
+
 void puttiletranslucent8(BITMAP* dest,int tile,int x,int y,int cset,int flip,int opacity);
 void overtiletranslucent8(BITMAP* dest,int tile,int x,int y,int cset,int flip,int opacity);
 void puttiletranslucent16(BITMAP* dest,int tile,int x,int y,int cset,int flip,int opacity);
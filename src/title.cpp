@@ -814,7 +814,7 @@ int readsaves(gamedata *savedata, PACKFILE *f)
     char name[9];
     byte tempbyte;
     short tempshort;
-    //  long templong;
+    long templong;
     word tempword;
     dword tempdword;
     long section_id=0;
@@ -1252,10 +1252,12 @@ int readsaves(gamedata *savedata, PACKFILE *f)
                 {
                     for(int k=0; k<8; k++)
                     {
-                        if(!p_igetl(&savedata[i].screen_d[j][k],f,true))
+                        if(!p_igetl(&templong,f,true))
                         {
                             return 43;
                         }
+                        
+                        savedata[i].screen_d.set(j, k, templong);
                     }
                 }
             }
@@ -1265,26 +1267,50 @@ int readsaves(gamedata *savedata, PACKFILE *f)
                 {
                     for(int k=0; k<8; k++)
                     {
-                        if(!p_igetl(&savedata[i].screen_d[j][k],f,true))
+                        if(!p_igetl(&templong,f,true))
                         {
                             return 43;
                         }
+                        
+                        savedata[i].screen_d.set(j, k, templong);
                     }
                 }
             }
-            else
+            else if(section_version < 12)
             {
                 for(int j=0; j<MAXDMAPS*MAPSCRSNORMAL; j++)
                 {
                     for(int k=0; k<8; k++)
                     {
-                        if(!p_igetl(&savedata[i].screen_d[j][k],f,true))
+                        if(!p_igetl(&templong,f,true))
                         {
                             return 43;
                         }
+                        
+                        savedata[i].screen_d.set(j, k, templong);
                     }
                 }
             }
+            else
+            {
+                // Only the non-zero values, as (screen*8+index, value) pairs.
+                if(!p_igetl(&tempdword,f,true))
+                {
+                    return 43;
+                }
+                
+                for(dword j=tempdword; j>0; --j)
+                {
+                    dword key;
+                    
+                    if(!p_igetl(&key,f,true) || !p_igetl(&templong,f,true))
+                    {
+                        return 43;
+                    }
+                    
+                    savedata[i].screen_d.set(key>>3, key&7, templong);
+                }
+            }
             
             for(int j=0; j<256; j++)
             {
@@ -1377,10 +1403,34 @@ int readsaves(gamedata *savedata, PACKFILE *f)
                 //We allocate the container
                 a.Resize(tempdword);
                 
-                //And then fill in the contents
-                for(dword k = 0; k < a.Size(); k++)
-                    if(!p_igetl(&(a[k]), f, true))
-                        return 55;
+                if(section_version < 12)
+                {
+                    //And then fill in the contents
+                    for(dword k = 0; k < a.Size(); k++)
+                        if(!p_igetl(&(a[k]), f, true))
+                            return 55;
+                }
+                else
+                {
+                    //The contents are runs of zeros, each followed by a run of other values
+                    for(dword k = 0; k < a.Size();)
+                    {
+                        dword zeros, values;
+                        
+                        //Every pair the writer makes covers at least one element
+                        if(!p_igetl(&zeros, f, true) || !p_igetl(&values, f, true) ||
+                                zeros+values == 0 ||
+                                zeros > a.Size()-k || values > a.Size()-k-zeros)
+                            return 55;
+                            
+                        for(; zeros > 0; --zeros)
+                            a[k++] = 0;
+                            
+                        for(; values > 0; --values)
+                            if(!p_igetl(&(a[k++]), f, true))
+                                return 55;
+                    }
+                }
             }
         }
     }
@@ -1605,6 +1655,7 @@ int writesaves(gamedata *savedata, PACKFILE *f)
     int section_version=V_SAVEGAME;
     int section_cversion=CV_SAVEGAME;
     int section_size=0;
+    std::vector<screen_d_map::entry> screen_d_entries;
     
     //section id
     if(!p_mputl(section_id,f))
@@ -1755,14 +1806,18 @@ int writesaves(gamedata *savedata, PACKFILE *f)
             return 42;
         }
         
-        for(int j=0; j<MAXDMAPS*MAPSCRSNORMAL; j++)
+        savedata[i].screen_d.get_entries(screen_d_entries);
+        
+        if(!p_iputl(screen_d_entries.size(),f))
+        {
+            return 43;
+        }
+        
+        for(dword j=0; j<screen_d_entries.size(); j++)
         {
-            for(int k=0; k<8; k++)
+            if(!p_iputl(screen_d_entries[j].key,f) || !p_iputl(screen_d_entries[j].value,f))
             {
-                if(!p_iputl(savedata[i].screen_d[j][k],f))
-                {
-                    return 43;
-                }
+                return 43;
             }
         }
         
@@ -1822,10 +1877,27 @@ int writesaves(gamedata *savedata, PACKFILE *f)
             if(!p_iputl(a.Size(), f))
                 return 52;
                 
-            //Followed by its contents
-            for(dword k = 0; k < a.Size(); k++)
-                if(!p_iputl(a[k], f))
+            //Followed by its contents, as runs of zeros each followed by a run of other values
+            for(dword k = 0; k < a.Size();)
+            {
+                dword start = k;
+                
+                while(k < a.Size() && a[k] == 0)
+                    ++k;
+                    
+                dword zeros = k - start;
+                start = k;
+                
+                while(k < a.Size() && a[k] != 0)
+                    ++k;
+                    
+                if(!p_iputl(zeros, f) || !p_iputl(k - start, f))
                     return 53;
+                    
+                for(dword l = start; l < k; l++)
+                    if(!p_iputl(a[l], f))
+                        return 53;
+            }
         }
     }
     
@@ -1846,33 +1918,42 @@ int save_savedgames()
         }
     }
     
-    char tmpfilename[32];
-    temp_name(tmpfilename);
-    
-    PACKFILE *f = pack_fopen_password(tmpfilename, F_WRITE_PACKED, "");
+    // Pack and encode the saves in memory, then replace the save file in
+    // a single write.
+    byte *packed = NULL;
+    long packedsize = 0;
+    PACKFILE *f = pack_fopen_memory_write(&packed, &packedsize, true);
     
     if(!f)
     {
-        delete_file(tmpfilename);
         return 2;
     }
     
     if(writesaves(saves, f)!=0)
     {
         pack_fclose(f);
-        delete_file(tmpfilename);
+        zc_free(packed);
         return 4;
     }
     
-    pack_fclose(f);
-    int ret = encode_file_007(tmpfilename, SAVE_FILE, 0x413F0000 + (frame&0xffff), SAVE_HEADER, ENC_METHOD_MAX-1);
+    if(pack_fclose(f))
+    {
+        return 2;
+    }
+    
+    byte *encoded = NULL;
+    long encodedsize = 0;
+    int ret = encode_memory_007(packed, packedsize, &encoded, &encodedsize, 0x413F0000 + (frame&0xffff), SAVE_HEADER, ENC_METHOD_MAX-1);
+    zc_free(packed);
     
+    if(!ret && !write_file_atomic(SAVE_FILE, encoded, encodedsize))
+        ret = 1;
+        
     if(ret)
         ret += 100;
         
-    delete_file(tmpfilename);
+    zc_free(encoded);
     
-    FILE *f2=NULL;
     char *iname = (char *)zc_malloc(2048);
     strcpy(iname, SAVE_FILE);
     
@@ -1883,13 +1964,7 @@ int save_savedgames()
     
     strcat(iname,".icn");
     
-    f2=fopen(iname,"wb");
-    byte *di2 = (byte *)iconbuffer;
-    
-    for(dword i=0; (i<sizeof(savedicon)*MAXSAVES); i++)
-        fputc(*(di2++),f2);
-        
-    fclose(f2);
+    write_file_atomic(iname, iconbuffer, sizeof(savedicon)*MAXSAVES);
     zc_free(iname);
     return ret;
 }
@@ -2096,6 +2171,7 @@ static void list_save(int save_num, int ypos)
     overtile16(framebuf,0,48,ypos+17,(save_num%3)+10,0);               //link
     newtilebuf[0].format=holdformat;
     newtilebuf[0].data = hold;
+    invalidate_tile_cache(0);
     
     hold = colordata;
     colordata = saves[save_num].pal;
@@ -2658,89 +2734,27 @@ static int get_quest_info(zquestheader *header,char *str)
         return 0;
     }
     
-    bool oldquest=false;
-    
     // default error
     strcpy(str,"Error: Invalid quest file");
     
-    char tmpfilename[32];
-    temp_name(tmpfilename);
-    int ret;
-    PACKFILE *f;
-    
-    const char *passwd = datapwd;
-    ret = decode_file_007(qstpath, tmpfilename, ENC_STR, ENC_METHOD_MAX-1, strstr(qstpath, ".dat#")!=NULL, passwd);
-    
-    if(ret)
-    {
-        switch(ret)
-        {
-        case 1:
-            strcpy(str,"Error: Unable to open file");
-            break;
-            
-        case 2:
-            strcpy(str,"Internal error occurred");
-            break;
-            // be sure not to delete tmpfilename now...
-        }
-        
-        if(ret==5)                                              //old encryption?
-        {
-            ret = decode_file_007(qstpath, tmpfilename, ENC_STR, ENC_METHOD_211B9, strstr(qstpath, ".dat#")!=NULL,passwd);
-        }
-        
-        if(ret==5)                                              //old encryption?
-        {
-            ret = decode_file_007(qstpath, tmpfilename, ENC_STR, ENC_METHOD_192B185, strstr(qstpath, ".dat#")!=NULL,passwd);
-        }
-        
-        if(ret==5)                                              //old encryption?
-        {
-            ret = decode_file_007(qstpath, tmpfilename, ENC_STR, ENC_METHOD_192B105, strstr(qstpath, ".dat#")!=NULL,passwd);
-        }
-        
-        if(ret==5)                                              //old encryption?
-        {
-            ret = decode_file_007(qstpath, tmpfilename, ENC_STR, ENC_METHOD_192B104, strstr(qstpath, ".dat#")!=NULL,passwd);
-        }
-        
-        if(ret)
-        {
-            oldquest = true;
-            passwd = "";
-        }
-    }
-    
-    f = pack_fopen_password(oldquest ? qstpath : tmpfilename, F_READ_PACKED, passwd);
+    char deletefilename[1024];
+    deletefilename[0]=0;
+    int ret=0;
+    PACKFILE *f = open_quest_file(&ret, qstpath, deletefilename, true, true, false);
     
     if(!f)
     {
-        if(!oldquest&&(errno==EDOM))
-        {
-            f = pack_fopen_password(oldquest ? qstpath : tmpfilename, F_READ, passwd);
-        }
-        
-        if(!f)
-        {
-            delete_file(tmpfilename);
-        }
-        
-        strcpy(str,"Error: Unable to open file");
+        strcpy(str, ret==qe_internal ? "Internal error occurred" : "Error: Unable to open file");
 //	setPackfilePassword(NULL);
         return 0;
     }
     
     ret=readheader(f, header, true);
+    pack_fclose(f);
     
-    if(f)
-    {
-        pack_fclose(f);
-    }
-    
-    if(!oldquest)
+    if(deletefilename[0])
     {
-        delete_file(tmpfilename);
+        delete_file(deletefilename);
     }
     
 //  setPackfilePassword(NULL);
@@ -3749,6 +3763,7 @@ static void list_saves2()
     overtile16(framebuf,0,48,i*24+73,i+10,0);               //link
     newtilebuf[0].format=holdformat;
     newtilebuf[0].data = hold;
+    invalidate_tile_cache(0);
 
     hold = colordata;
     colordata = saves[listpos+i].pal;
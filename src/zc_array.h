@@ -42,6 +42,8 @@ ArrayIterator<*>{
 #ifndef __zc_array_h_
 #define __zc_array_h_
 
+#include <algorithm>
+
 //#define _DEBUGZCARRAY
 
 
@@ -176,31 +178,31 @@ public:
     typedef T* pointer;
     typedef T type;
     
-    ZCArray() : _ptr(NULL), _size(0)
+    ZCArray() : _ptr(NULL), _size(0), _capacity(0)
     {
         for(int i = 0; i < 4; i++)
             _dim[i] = 0;
     }
     
-    ZCArray(size_type _Size) : _ptr(NULL)
+    ZCArray(size_type _Size) : _ptr(NULL), _capacity(0)
     {
         _SetDimensions(0, 0, _Size);
         _Alloc(_size);
     }
     
-    ZCArray(size_type _Y, size_type _X) : _ptr(NULL)
+    ZCArray(size_type _Y, size_type _X) : _ptr(NULL), _capacity(0)
     {
         _SetDimensions(0, _Y, _X);
         _Alloc(_size);
     }
     
-    ZCArray(size_type _Z, size_type _Y, size_type _X) : _ptr(NULL)
+    ZCArray(size_type _Z, size_type _Y, size_type _X) : _ptr(NULL), _capacity(0)
     {
         _SetDimensions(_Z, _Y, _X);
         _Alloc(_size);
     }
     
-    ZCArray(const ZCArray &_Array) : _ptr(NULL), _size(0)
+    ZCArray(const ZCArray &_Array) : _ptr(NULL), _size(0), _capacity(0)
     {
         for(int i = 0; i < 4; i++) _dim[i] = 0;
         
@@ -390,8 +392,7 @@ public:
     
     void Assign(const size_type _Begin, const size_type _End, const type& _Val = type())
     {
-        for(size_type i(_Begin); i < _End; i++)
-            _ptr[ i ] = _Val;
+        std::fill(_ptr + _Begin, _ptr + _End, _Val);
     }
     
     void Resize(const size_type _Size)
@@ -461,9 +462,80 @@ public:
         Resize(0);
     }
     
+    // Storage is handed out in power of two sizes and freed blocks are kept
+    // for reuse, so that arrays created and destroyed every frame by scripts
+    // don't go to the heap each time.
+    struct PoolStats
+    {
+        unsigned long allocs;   //blocks handed out
+        unsigned long reused;   //of which came from the free lists
+        unsigned long frees;
+    };
+    
+    static const PoolStats &GetPoolStats()
+    {
+        return _poolStats;
+    }
+    
+    static void ResetPoolStats()
+    {
+        _poolStats.allocs = _poolStats.reused = _poolStats.frees = 0;
+    }
+    
     
 protected:
 
+    enum
+    {
+        _PoolMin = 8,           //smallest block, in elements
+        _PoolClasses = 10,      //so the largest pooled block is 4096 elements
+        _PoolDepth = 64         //free blocks kept per size
+    };
+    
+    static int _PoolClass(size_type size)
+    {
+        int c = 0;
+        
+        while(c < _PoolClasses && (size_type(_PoolMin) << c) < size)
+            ++c;
+            
+        return c;
+    }
+    
+    static pointer _PoolGet(size_type size, size_type &capacity)
+    {
+        const int c = _PoolClass(size);
+        ++_poolStats.allocs;
+        
+        if(c == _PoolClasses)
+        {
+            capacity = size;
+            return new type[ size ];
+        }
+        
+        capacity = size_type(_PoolMin) << c;
+        
+        if(_poolCount[c] > 0)
+        {
+            ++_poolStats.reused;
+            return _pool[c][ --_poolCount[c] ];
+        }
+        
+        return new type[ capacity ];
+    }
+    
+    static void _PoolPut(pointer _Ptr, size_type capacity)
+    {
+        const int c = _PoolClass(capacity);
+        ++_poolStats.frees;
+        
+        if(c < _PoolClasses && (size_type(_PoolMin) << c) == capacity && _poolCount[c] < _PoolDepth)
+            _pool[c][ _poolCount[c]++ ] = _Ptr;
+        else
+            delete [] _Ptr;
+    }
+    
+
     void _Alloc(size_type size)
     {
     
@@ -471,9 +543,6 @@ protected:
         al_trace("Memory to allocate: %i\n", size);
 #endif
         
-        if(_ptr)
-            _Delete();
-            
         if(size == 0)
         {
             al_trace("Tried to allocate zero sized array\n");
@@ -484,40 +553,51 @@ protected:
 #endif
         }
         
-        _ptr = new type[ size ];
+        if(_ptr && size <= _capacity)
+        {
+            _size = size;
+            return;
+        }
+        
+        if(_ptr)
+            _Delete();
+            
+        _ptr = _PoolGet(size, _capacity);
         _size = size;
     }
     
     void _ReAssign(const size_type _OldSize, const size_type _NewSize)
     {
+        if(_ptr && _NewSize <= _capacity)
+        {
+            _size = _NewSize;
+            return;
+        }
+        
         pointer _oldPtr = _ptr;
-        _ptr = new type[ _NewSize ];
+        const size_type _oldCapacity = _capacity;
+        _ptr = _PoolGet(_NewSize, _capacity);
         
         const size_type _copyRange = (_OldSize < _NewSize ? _OldSize : _NewSize);
         
         for(size_type i(0); i < _copyRange; i++)
             _ptr[ i ] = _oldPtr[ i ];
             
-        _Delete(_oldPtr);
+        if(_oldPtr)
+            _PoolPut(_oldPtr, _oldCapacity);
+            
         _size = _NewSize;
     }
     
     void _Delete()
     {
         if(_ptr)
-            delete [] _ptr;
+            _PoolPut(_ptr, _capacity);
             
         _ptr = NULL;
         
         _size = 0;
-    }
-    
-    void _Delete(pointer _Ptr)
-    {
-        if(_Ptr)
-            delete [] _Ptr;
-            
-        _Ptr = NULL;
+        _capacity = 0;
     }
     
     void _SetDimensions(size_type _Z, size_type _Y, size_type _X)
@@ -603,9 +683,23 @@ protected:
 private:
     pointer _ptr;
     size_type _size;
+    size_type _capacity;
     size_type _dim[ 4 ];
     
+    static pointer _pool[ _PoolClasses ][ _PoolDepth ];
+    static int _poolCount[ _PoolClasses ];
+    static PoolStats _poolStats;
+    
 };
 
+template <typename T>
+typename ZCArray<T>::pointer ZCArray<T>::_pool[ ZCArray<T>::_PoolClasses ][ ZCArray<T>::_PoolDepth ];
+
+template <typename T>
+int ZCArray<T>::_poolCount[ ZCArray<T>::_PoolClasses ];
+
+template <typename T>
+typename ZCArray<T>::PoolStats ZCArray<T>::_poolStats;
+
 #endif
 
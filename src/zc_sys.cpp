@@ -25,11 +25,19 @@
 #include "zc_init.h"
 #include "zquest.h"
 #include "init.h"
+#include "replay.h"
+#include "benchmark.h"
+#include "frametiming.h"
 
 #ifdef ALLEGRO_DOS
 #include <unistd.h>
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ZC_SYS_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "zdefs.h"
 #include "zelda.h"
 #include "tiles.h"
@@ -3573,11 +3581,87 @@ void draw_fuzzy(int fuzz)
     }
 }
 
+// Writes a row of 'w' pixels from 'src' to 'dest', each repeated 'scale' times.
+static void scale_row(byte *dest, const byte *src, int w, int scale)
+{
+    int x = 0;
+    
+#ifdef ZC_SYS_SSE2
+    if(scale == 2 || scale == 4)
+    {
+        for(; x + 16 <= w; x += 16)
+        {
+            const __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+            const __m128i lo = _mm_unpacklo_epi8(v, v);
+            const __m128i hi = _mm_unpackhi_epi8(v, v);
+            __m128i *d = (__m128i *)(dest + x * scale);
+            
+            if(scale == 2)
+            {
+                _mm_storeu_si128(d, lo);
+                _mm_storeu_si128(d + 1, hi);
+            }
+            else
+            {
+                _mm_storeu_si128(d, _mm_unpacklo_epi8(lo, lo));
+                _mm_storeu_si128(d + 1, _mm_unpackhi_epi8(lo, lo));
+                _mm_storeu_si128(d + 2, _mm_unpacklo_epi8(hi, hi));
+                _mm_storeu_si128(d + 3, _mm_unpackhi_epi8(hi, hi));
+            }
+        }
+    }
+#endif
+    
+    for(; x < w; x++)
+    {
+        byte *d = dest + x * scale;
+        
+        for(int i = 0; i < scale; i++)
+            d[i] = src[x];
+    }
+}
+
+// Draws the 256x224 'source' at an integer scale straight into 'target',
+// blacking out the second line of every scaled row if 'scanlines' is set.
+// Returns false if the target isn't an 8-bit linear bitmap the frame fits
+// in, in which case nothing is drawn.
+static bool scale_frame(BITMAP *source, BITMAP *target, int dx, int dy, int scale, bool scanlines)
+{
+    static byte row[256*6];
+    
+    if(scale < 2 || scale > 6 || !is_linear_bitmap(target) ||
+            bitmap_color_depth(source) != 8 || bitmap_color_depth(target) != 8 ||
+            dx < 0 || dy < 0 || dx + 256*scale > target->w || dy + 224*scale > target->h)
+        return false;
+        
+    acquire_bitmap(target);
+    
+    for(int y = 0; y < 224; y++)
+    {
+        scale_row(row, source->line[y], 256, scale);
+        
+        for(int i = 0; i < scale; i++)
+        {
+            byte *d = (byte *)bmp_write_line(target, dy + y*scale + i) + dx;
+            
+            if(scanlines && i == 1)
+                memset(d, BLACK, 256*scale);
+            else
+                memcpy(d, row, 256*scale);
+        }
+    }
+    
+    bmp_unwrite_line(target);
+    release_bitmap(target);
+    return true;
+}
+
 void updatescr(bool allowwavy)
 {
     static BITMAP *wavybuf = create_bitmap_ex(8,256,224);
     static BITMAP *panorama = create_bitmap_ex(8,256,224);
-        
+    frame_phase_timer timer(fpUPDATESCR);
+    
     if(toogam)
     {
         textout_ex(framebuf,font,"no walls",8,216,1,-1);
@@ -3615,15 +3699,7 @@ void updatescr(bool allowwavy)
         RAMpal[254] = _RGB(63,63,63);
         set_palette_range(RAMpal,0,255,false);
         
-        create_rgb_table(&rgb_table, RAMpal, NULL);
-        create_zc_trans_table(&trans_table, RAMpal, 128, 128, 128);
-        memcpy(&trans_table2, &trans_table, sizeof(COLOR_MAP));
-        
-        for(int q=0; q<PAL_SIZE; q++)
-        {
-            trans_table2.data[0][q] = q;
-            trans_table2.data[q][q] = q;
-        }
+        refresh_palette_tables();
     }
     
     if(details)
@@ -3639,11 +3715,19 @@ void updatescr(bool allowwavy)
         wavy = (DMaps[currdmap].flags&dmfWAVY ? 4 : 0);
     }
     
-    blit(framebuf, wavybuf, 0, 0, 0, 0, 256, 224);
+    // The frame is copied aside when it's about to be changed, since the
+    // message is drawn over framebuf afterward without being shown.
+    bool drawwavy = wavy && Playing && allowwavy;
+    bool drawmsg = !(msgdisplaybuf->clip) && Playing && msgpos && !screenscrolling;
+    BITMAP *frame_src = framebuf;
     
-    if(wavy && Playing && allowwavy)
+    if(drawwavy || drawmsg)
     {
-        draw_wavy(framebuf, wavybuf, wavy,false);
+        blit(framebuf, wavybuf, 0, 0, 0, 0, 256, 224);
+        frame_src = wavybuf;
+        
+        if(drawwavy)
+            draw_wavy(framebuf, wavybuf, wavy,false);
     }
     
     if(clearwavy)
@@ -3651,7 +3735,7 @@ void updatescr(bool allowwavy)
     else if(Playing && !Paused)
         wavy--; // Wavy was set by a script. Decrement it.
         
-    if(!(msgdisplaybuf->clip) && Playing && msgpos && !screenscrolling)
+    if(drawmsg)
     {
         masked_blit(msgdisplaybuf,framebuf,0,0,0,playing_field_offset,256,168);
     }
@@ -3676,11 +3760,17 @@ void updatescr(bool allowwavy)
     {
         rectfill(panorama,0,0,255,passive_subscreen_height/2,0);
         rectfill(panorama,0,168+passive_subscreen_height/2,255,168+passive_subscreen_height-1,0);
-        blit(wavybuf,panorama,0,playing_field_offset,0,passive_subscreen_height/2,256,224-passive_subscreen_height);
+        blit(frame_src,panorama,0,playing_field_offset,0,passive_subscreen_height/2,256,224-passive_subscreen_height);
+    }
+    
+    if(headless)
+    {
+        ++framecnt;
+        return;
     }
     
     //TODO: Optimize blit 'overcalls' -Gleeok
-    BITMAP *source = nosubscr ? panorama : wavybuf;
+    BITMAP *source = nosubscr ? panorama : frame_src;
     BITMAP *target = NULL;
     
     bool dontusetb = triplebuffer_not_available ||
@@ -3713,7 +3803,11 @@ void updatescr(bool allowwavy)
     
     if(sbig)
     {
-        if(scanlines)
+        if(scale_frame(source, target, scrx+32-mx, scry+8-my, screen_scale, scanlines != 0))
+        {
+            // Drawn directly
+        }
+        else if(scanlines)
         {
             if(!scanlinesbmp)
                 scanlinesbmp = create_bitmap_ex(8, sx, sy);
@@ -3751,6 +3845,8 @@ void updatescr(bool allowwavy)
     if(ShowFPS)
         show_fps(target);
         
+    show_frame_timing(target);
+    
     if(Paused)
         show_paused(target);
         
@@ -4402,7 +4498,23 @@ void syskeys()
     
     if(ReadKey(KEY_CLOSEBRACE))    if(frame_rest_suggest <= 2) frame_rest_suggest++;
     
-    if(ReadKey(KEY_F2))    ShowFPS=!ShowFPS;
+    if(ReadKey(KEY_F2))
+    {
+        if(key[KEY_ZC_LCONTROL] || key[KEY_ZC_RCONTROL])
+        {
+            if(script_profiling) stop_script_profiler();
+            else start_script_profiler();
+        }
+        else if(key[KEY_LSHIFT] || key[KEY_RSHIFT])
+        {
+            if(frame_timing) stop_frame_timing();
+            else start_frame_timing();
+        }
+        else
+        {
+            ShowFPS=!ShowFPS;
+        }
+    }
     
     if(ReadKey(KEY_F3) && Playing)    Paused=!Paused;
     
@@ -4727,6 +4839,7 @@ void advanceframe(bool allowwavy, bool sfxcleanup)
         
     Advance=false;
     ++frame;
+    replay_frame();
     
     syskeys();
     // Someday... maybe install a Turbo button here?
@@ -4745,6 +4858,8 @@ void advanceframe(bool allowwavy, bool sfxcleanup)
     //textprintf_ex(screen,font,0,72,254,BLACK,"%d %d", lastentrance, lastentrance_dmap);
     if(sfxcleanup)
         sfx_cleanup();
+        
+    next_frame_timing();
 }
 
 void zapout()
@@ -8941,6 +9056,8 @@ void load_control_state()
         control_state[17]= STICK_2_X.pos - js_stick_2_x_offset > STICK_PRECISION;
     }
     
+    replay_input(control_state);
+    
     button_press[0]=rButton(Up,button_hold[0]);
     button_press[1]=rButton(Down,button_hold[1]);
     button_press[2]=rButton(Left,button_hold[2]);
@@ -9304,8 +9421,7 @@ bool ReadKey(int k)
 
 void zc_putpixel(int layer, int x, int y, int cset, int color, int timer)
 {
-    timer=timer;
-    particles.add(new particle(fix(x), fix(y), layer, cset, color));
+    add_pooled_particle(layer, x, y, cset, color, timer);
 }
 
 // these are here so that copy_dialog won't choke when compiling zelda
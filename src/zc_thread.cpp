@@ -0,0 +1,128 @@
+#include "zc_thread.h"
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <process.h>
+
+struct zc_thread
+{
+    HANDLE handle;
+    zc_thread_func func;
+    void *arg;
+};
+
+static unsigned __stdcall zc_thread_start(void *data)
+{
+    zc_thread *t = (zc_thread *)data;
+    t->func(t->arg);
+    return 0;
+}
+
+zc_thread *zc_thread_create(zc_thread_func func, void *arg)
+{
+    zc_thread *t = new zc_thread;
+    t->func = func;
+    t->arg = arg;
+    t->handle = (HANDLE)_beginthreadex(NULL, 0, zc_thread_start, t, 0, NULL);
+    
+    if(!t->handle)
+    {
+        delete t;
+        return NULL;
+    }
+    
+    return t;
+}
+
+void zc_thread_join(zc_thread *t)
+{
+    WaitForSingleObject(t->handle, INFINITE);
+    CloseHandle(t->handle);
+    delete t;
+}
+
+int zc_cpu_count()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+long zc_atomic_next(volatile long *counter)
+{
+    return InterlockedIncrement(counter) - 1;
+}
+
+unsigned long long zc_clock_us()
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    
+    if(!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+        
+    QueryPerformanceCounter(&now);
+    return (unsigned long long)(now.QuadPart / freq.QuadPart) * 1000000 + (now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+}
+
+#else // Non-Windows
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+struct zc_thread
+{
+    pthread_t handle;
+    zc_thread_func func;
+    void *arg;
+};
+
+static void *zc_thread_start(void *data)
+{
+    zc_thread *t = (zc_thread *)data;
+    t->func(t->arg);
+    return 0;
+}
+
+zc_thread *zc_thread_create(zc_thread_func func, void *arg)
+{
+    zc_thread *t = new zc_thread;
+    t->func = func;
+    t->arg = arg;
+    
+    if(pthread_create(&t->handle, 0, zc_thread_start, t) != 0)
+    {
+        delete t;
+        return NULL;
+    }
+    
+    return t;
+}
+
+void zc_thread_join(zc_thread *t)
+{
+    pthread_join(t->handle, 0);
+    delete t;
+}
+
+int zc_cpu_count()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+long zc_atomic_next(volatile long *counter)
+{
+    return __sync_fetch_and_add(counter, 1);
+}
+
+unsigned long long zc_clock_us()
+{
+    timeval tv;
+    gettimeofday(&tv, 0);
+    return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+#endif
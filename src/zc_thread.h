@@ -0,0 +1,26 @@
+#ifndef _ZC_THREAD_H_
+#define _ZC_THREAD_H_
+
+// Minimal worker threads and a high resolution clock. The platform headers
+// stay in zc_thread.cpp so that they don't clash with Allegro's.
+
+typedef void (*zc_thread_func)(void *);
+
+struct zc_thread;
+
+// Runs func(arg) on a new thread. Returns NULL if it couldn't be started.
+zc_thread *zc_thread_create(zc_thread_func func, void *arg);
+
+// Waits for the thread to finish and frees it.
+void zc_thread_join(zc_thread *t);
+
+// Number of processors available to the program; at least 1.
+int zc_cpu_count();
+
+// Adds one to *counter and returns its previous value, atomically.
+long zc_atomic_next(volatile long *counter);
+
+// Microseconds since some arbitrary point; only differences are meaningful.
+unsigned long long zc_clock_us();
+
+#endif
@@ -15,7 +15,6 @@
 //Conditional Debugging Compilation
 //Script related
 #define _FFDEBUG
-//#define _SCRIPT_COUNTER
 //#define _FFDISSASSEMBLY
 //#define _FFONESCRIPTDISSASSEMBLY
 
@@ -189,7 +188,7 @@ enum {ENC_METHOD_192B104=0, ENC_METHOD_192B105, ENC_METHOD_192B185, ENC_METHOD_2
 #define V_GUYS            38
 #define V_MIDIS            4
 #define V_CHEATS           1
-#define V_SAVEGAME        11
+#define V_SAVEGAME        12
 #define V_COMBOALIASES     3
 #define V_LINKSPRITES      5
 #define V_SUBSCREEN        6
@@ -253,6 +252,7 @@ typedef unsigned long long   qword;                              //0-18,446,744,
 
 extern int readsize, writesize;
 extern bool fake_pack_writing;
+extern PACKFILE *uncounted_pack;
 
 // system colors
 #define lc1(x) ((x)+192)                                    // offset to 'level bg color' x (row 12)
@@ -2979,6 +2979,37 @@ enum {i_bombbag1=1, i_bombbag2, i_bombbag3, i_bombbag4, imax_bombbag};
 
 //enum {i_clock=1, imax_clock};
 
+// Script-controlled screen variables (Screen->D[]). Nearly all of them
+// are zero, so only the others are kept, in an open addressing table
+// keyed by screen*8+index.
+class screen_d_map
+{
+public:
+    struct entry
+    {
+        dword key;
+        long value;
+    };
+    
+    screen_d_map(): count(0) {}
+    
+    long get(dword screen, int index) const;
+    void set(dword screen, int index, long value);
+    void clear();
+    dword size() const
+    {
+        return count;
+    }
+    // The non-zero entries, sorted by key.
+    void get_entries(std::vector<entry> &out) const;
+    
+private:
+    std::vector<entry> slots;
+    dword count;
+    
+    void rehash(dword newsize);
+};
+
 struct gamedata
 {
     //private:
@@ -3034,7 +3065,7 @@ struct gamedata
     char  qstpath[2048];
     byte  icon[128];
     byte  pal[48];
-    long  screen_d[MAXDMAPS*MAPSCRSNORMAL][8];                // script-controlled screen variables
+    screen_d_map screen_d;                                    // script-controlled screen variables
     long  global_d[256];                                      // script-controlled global variables
     std::vector< ZCArray <long> > globalRAM;
     
@@ -3341,6 +3372,19 @@ static INLINE bool is_between(T a, T b, T c, bool inclusive)
 
 #define NEWALLEGRO
 
+// Packfiles from pack_fopen_vtable() (the in-memory ones) have no 'normal'
+// block, so the p_* helpers only check its mode flags on real files.
+
+// uncounted_pack is being read on a worker thread, so its reads stay out
+// of readsize, which belongs to the main thread.
+INLINE void count_read(long n,PACKFILE *f)
+{
+    if(f!=uncounted_pack)
+    {
+        readsize+=n;
+    }
+}
+
 INLINE bool pfwrite(void *p,long n,PACKFILE *f)
 {
     bool success=true;
@@ -3368,7 +3412,7 @@ INLINE bool pfread(void *p,long n,PACKFILE *f,bool keepdata)
         
         if(success)
         {
-            readsize+=n;
+            count_read(n,f);
         }
         
         return success;
@@ -3379,7 +3423,7 @@ INLINE bool pfread(void *p,long n,PACKFILE *f,bool keepdata)
         
         if(success)
         {
-            readsize+=n;
+            count_read(n,f);
         }
         
         return success;
@@ -3395,7 +3439,7 @@ INLINE bool p_getc(void *p,PACKFILE *f,bool keepdata)
     
 #ifdef NEWALLEGRO
     
-    if(f->normal.flags&PACKFILE_FLAG_WRITE) return false;     //must not be writing to file
+    if(f->is_normal_packfile && (f->normal.flags&PACKFILE_FLAG_WRITE)) return false;     //must not be writing to file
     
 #else
     
@@ -3420,7 +3464,7 @@ INLINE bool p_getc(void *p,PACKFILE *f,bool keepdata)
         *cp = c;
     }
     
-    readsize+=1;
+    count_read(1,f);
     return true;
 }
 
@@ -3434,7 +3478,7 @@ INLINE bool p_putc(int c,PACKFILE *f)
         
 #ifdef NEWALLEGRO
         
-        if(!(f->normal.flags&PACKFILE_FLAG_WRITE)) return false;  //must be writing to file
+        if(f->is_normal_packfile && !(f->normal.flags&PACKFILE_FLAG_WRITE)) return false;  //must be writing to file
         
 #else
         
@@ -3463,7 +3507,7 @@ INLINE bool p_igetw(void *p,PACKFILE *f,bool keepdata)
     
 #ifdef NEWALLEGRO
     
-    if(f->normal.flags&PACKFILE_FLAG_WRITE) return false;     //must not be writing to file
+    if(f->is_normal_packfile && (f->normal.flags&PACKFILE_FLAG_WRITE)) return false;     //must not be writing to file
     
 #else
     
@@ -3488,7 +3532,7 @@ INLINE bool p_igetw(void *p,PACKFILE *f,bool keepdata)
         *cp = c;
     }
     
-    readsize+=2;
+    count_read(2,f);
     return true;
 }
 
@@ -3502,7 +3546,7 @@ INLINE bool p_iputw(int c,PACKFILE *f)
         
 #ifdef NEWALLEGRO
         
-        if(!(f->normal.flags&PACKFILE_FLAG_WRITE)) return false;  //must be writing to file
+        if(f->is_normal_packfile && !(f->normal.flags&PACKFILE_FLAG_WRITE)) return false;  //must be writing to file
         
 #else
         
@@ -3531,7 +3575,7 @@ INLINE bool p_igetl(void *p,PACKFILE *f,bool keepdata)
     
 #ifdef NEWALLEGRO
     
-    if(f->normal.flags&PACKFILE_FLAG_WRITE) return false;     //must not be writing to file
+    if(f->is_normal_packfile && (f->normal.flags&PACKFILE_FLAG_WRITE)) return false;     //must not be writing to file
     
 #else
     
@@ -3556,7 +3600,7 @@ INLINE bool p_igetl(void *p,PACKFILE *f,bool keepdata)
         *cp = c;
     }
     
-    readsize+=4;
+    count_read(4,f);
     return true;
 }
 
@@ -3574,7 +3618,7 @@ INLINE bool p_igetf(void *p,PACKFILE *f,bool keepdata)
     
 #ifdef NEWALLEGRO
     
-    if(f->normal.flags&PACKFILE_FLAG_WRITE) return false;     //must not be writing to file
+    if(f->is_normal_packfile && (f->normal.flags&PACKFILE_FLAG_WRITE)) return false;     //must not be writing to file
     
 #else
     
@@ -3612,7 +3656,7 @@ INLINE bool p_igetf(void *p,PACKFILE *f,bool keepdata)
 #endif
     }
     
-    readsize += sizeof(float);
+    count_read(sizeof(float),f);
     return true;
 }
 
@@ -3626,7 +3670,7 @@ INLINE bool p_iputl(long c,PACKFILE *f)
         
 #ifdef NEWALLEGRO
         
-        if(!(f->normal.flags&PACKFILE_FLAG_WRITE)) return false;  //must be writing to file
+        if(f->is_normal_packfile && !(f->normal.flags&PACKFILE_FLAG_WRITE)) return false;  //must be writing to file
         
 #else
         
@@ -3655,7 +3699,7 @@ INLINE bool p_mgetw(void *p,PACKFILE *f,bool keepdata)
     
 #ifdef NEWALLEGRO
     
-    if(f->normal.flags&PACKFILE_FLAG_WRITE) return false;     //must not be writing to file
+    if(f->is_normal_packfile && (f->normal.flags&PACKFILE_FLAG_WRITE)) return false;     //must not be writing to file
     
 #else
     
@@ -3680,7 +3724,7 @@ INLINE bool p_mgetw(void *p,PACKFILE *f,bool keepdata)
         *cp = c;
     }
     
-    readsize+=2;
+    count_read(2,f);
     return true;
 }
 
@@ -3694,7 +3738,7 @@ INLINE bool p_mputw(int c,PACKFILE *f)
         
 #ifdef NEWALLEGRO
         
-        if(!(f->normal.flags&PACKFILE_FLAG_WRITE)) return false;  //must be writing to file
+        if(f->is_normal_packfile && !(f->normal.flags&PACKFILE_FLAG_WRITE)) return false;  //must be writing to file
         
 #else
         
@@ -3723,7 +3767,7 @@ INLINE bool p_mgetl(void *p,PACKFILE *f,bool keepdata)
     
 #ifdef NEWALLEGRO
     
-    if(f->normal.flags&PACKFILE_FLAG_WRITE) return false;     //must not be writing to file
+    if(f->is_normal_packfile && (f->normal.flags&PACKFILE_FLAG_WRITE)) return false;     //must not be writing to file
     
 #else
     
@@ -3748,7 +3792,7 @@ INLINE bool p_mgetl(void *p,PACKFILE *f,bool keepdata)
         *cp = c;
     }
     
-    readsize+=4;
+    count_read(4,f);
     return true;
 }
 
@@ -3762,7 +3806,7 @@ INLINE bool p_mputl(long c,PACKFILE *f)
         
 #ifdef NEWALLEGRO
         
-        if(!(f->normal.flags&PACKFILE_FLAG_WRITE)) return false;  //must be writing to file
+        if(f->is_normal_packfile && !(f->normal.flags&PACKFILE_FLAG_WRITE)) return false;  //must be writing to file
         
 #else
         
@@ -52,6 +52,9 @@
 #include "ffscript.h"
 extern FFScript FFCore; //the core script engine.
 #include "init.h"
+#include "replay.h"
+#include "benchmark.h"
+#include "frametiming.h"
 #include <assert.h>
 #include "zc_array.h"
 #include "rendertarget.h"
@@ -134,17 +137,17 @@ void update_logic_counter()
 }
 END_OF_FUNCTION(update_logic_counter)
 
-#ifdef _SCRIPT_COUNTER
-volatile int script_counter=0;
-void update_script_counter()
-{
-    ++script_counter;
-}
-END_OF_FUNCTION(update_script_counter)
-#endif
 
 void throttleFPS()
 {
+    if(headless)
+    {
+        logic_counter = 0;
+        return;
+    }
+    
+    frame_phase_timer timer(fpTHROTTLE);
+    
 #ifdef _WIN32           // TEMPORARY!! -Trying to narrow down a win10 bug that affects performance.
     timeBeginPeriod(1); // Basically, jist is that other programs can affect the FPS of ZC in weird ways. (making it better for example... go figure)
 #endif
@@ -247,10 +250,10 @@ char       palnames[MAXLEVELS][PALNAMESIZE];
 tiledata   *newtilebuf, *grabtilebuf;
 newcombo   *combobuf;
 word animated_combo_table[MAXCOMBOS][2];                    //[0]=position in act2, [1]=original tile
-word animated_combo_table4[MAXCOMBOS][2];                   //[0]=combo, [1]=clock
+word animated_combo_table4[MAXCOMBOS][2];                   //[0]=combo, [1]=frame the clock was reset
 word animated_combos;
 word animated_combo_table2[MAXCOMBOS][2];                    //[0]=position in act2, [1]=original tile
-word animated_combo_table24[MAXCOMBOS][2];                   //[0]=combo, [1]=clock
+word animated_combo_table24[MAXCOMBOS][2];                   //[0]=combo, [1]=frame the clock was reset
 word animated_combos2;
 bool blank_tile_table[NEWMAXTILES];                         //keeps track of blank tiles
 bool blank_tile_quarters_table[NEWMAXTILES*4];              //keeps track of blank tiles
@@ -288,6 +291,7 @@ bool usebombpal;
 
 int readsize, writesize;
 bool fake_pack_writing=false;
+PACKFILE *uncounted_pack=NULL;
 combo_alias combo_aliases[MAXCOMBOALIASES];  //Temporarily here so ZC can compile. All memory from this is freed after loading the quest file.
 
 SAMPLE customsfxdata[WAV_COUNT];
@@ -403,6 +407,8 @@ void initZScriptArrayRAM(bool firstplay)
         arrayOwner[i]=255;
     }
     
+    reset_local_arrays();
+    
     if(game->globalRAM.size() != 0)
         game->globalRAM.clear();
         
@@ -1032,6 +1038,7 @@ void ALLOFF(bool messagesToo, bool decorationsToo)
         decorations.clear();
         
     particles.clear();
+    clear_pooled_particles();
     
     if(Link.getNayrusLoveShieldClk())
     {
@@ -1358,6 +1365,8 @@ int load_quest(gamedata *g, bool report)
     
     int ret = loadquest(qstpath,&QHeader,&QMisc,tunes+ZC_MIDI_COUNT,false,true,true,true,skip_flags);
     //setPackfilePassword(NULL);
+    clear_decoded_scripts(); //The script buffers were reallocated
+    clear_tile_cache(); //...and so were the tiles
     
     if(!g->title[0] || g->get_hasplayed() == 0)
     {
@@ -1421,7 +1430,7 @@ int init_game()
 	
 	
   //port250QuestRules();	
-    srand(time(0));
+    srand(replay_seed(time(0)));
     //introclk=intropos=msgclk=msgpos=dmapmsgclk=0;
 	FFCore.kb_typing_mode = false;
 	draw_screen_clip_rect_x1=0; //Prevent the ending sequence from carrying over through 'Reset System' -Z
@@ -1732,7 +1741,7 @@ int init_game()
 /*
     if(firstplay)
     {
-        memset(game->screen_d, 0, MAXDMAPS * 64 * 8 * sizeof(long));
+        game->screen_d.clear();
         ZScriptVersion::RunScript(SCRIPT_GLOBAL, GLOBAL_SCRIPT_INIT);
     }
     else
@@ -1837,7 +1846,7 @@ int init_game()
     
     if(firstplay)
     {
-        memset(game->screen_d, 0, MAXDMAPS * 64 * 8 * sizeof(long));
+        game->screen_d.clear();
         ZScriptVersion::RunScript(SCRIPT_GLOBAL, GLOBAL_SCRIPT_INIT);
     }
     else
@@ -2297,34 +2306,25 @@ void do_magic_casting()
                     {
                         if(itemsbuf[magicitem].misc1==1)  // Twilight
                         {
-                            particles.add(new pTwilight(Link.getX()+j, Link.getY()-Link.getZ()+i, 5, 0, 0, (rand()%8)+i*4));
-                            int k=particles.Count()-1;
-                            particle *p = (particle*)(particles.spr(k));
-                            p->step=3;
+                            add_rising_particle(5, Link.getX()+j, Link.getY()-Link.getZ()+i, 0, 0, (rand()%8)+i*4, (fix)3);
                         }
                         else if(itemsbuf[magicitem].misc1==2)  // Sands of Hours
                         {
-                            particles.add(new pTwilight(Link.getX()+j, Link.getY()-Link.getZ()+i, 5, 1, 2, (rand()%16)+i*2));
-                            int k=particles.Count()-1;
-                            particle *p = (particle*)(particles.spr(k));
-                            p->step=4;
+                            int delay=(rand()%16)+i*2;
                             
                             if(rand()%10 < 2)
                             {
-                                p->color=1;
-                                p->cset=0;
+                                add_rising_particle(5, Link.getX()+j, Link.getY()-Link.getZ()+i, 0, 1, delay, (fix)4);
+                            }
+                            else
+                            {
+                                add_rising_particle(5, Link.getX()+j, Link.getY()-Link.getZ()+i, 1, 2, delay, (fix)4);
                             }
                         }
                         else
                         {
-                            particles.add(new pFaroresWindDust(Link.getX()+j, Link.getY()-Link.getZ()+i, 5, 6, linktilebuf[i*16+j], rand()%96));
-                            
-                            int k=particles.Count()-1;
-                            particle *p = (particle*)(particles.spr(k));
-                            p->angular=true;
-                            p->angle=rand();
-                            p->step=(((double)j)/8);
-                            p->yofs=Link.getYOfs();
+                            int timer=rand()%96;
+                            add_drifting_particle(5, Link.getX()+j, Link.getY()-Link.getZ()+i, Link.getYOfs(), 6, linktilebuf[i*16+j], timer, rand(), (fix)(((double)j)/8));
                         }
                     }
                 }
@@ -2714,7 +2714,10 @@ void game_loop()
     #if LOGGAMELOOP > 0
     al_trace("game_loop is calling: %s\n", "animate_combos()\n");
     #endif
-    animate_combos();
+    {
+        frame_phase_timer timer(fpCOMBOS);
+        animate_combos();
+    }
     #if LOGGAMELOOP > 0
     al_trace("game_loop is calling: %s\n", "load_control_state()\n");
     #endif
@@ -2727,12 +2730,14 @@ void game_loop()
     
     if(!freezeff)
     {
+        frame_phase_timer timer(fpFFCSCRIPTS);
         update_freeform_combos();
     }
     
     // Arbitrary Rule 637: neither 'freeze' nor 'freezeff' freeze the global script.
     if(!freezemsg && g_doscript)
     {
+        frame_phase_timer timer(fpGLOBALSCRIPT);
         ZScriptVersion::RunScript(SCRIPT_GLOBAL, GLOBAL_SCRIPT_GAME);
     }
     
@@ -2753,7 +2758,10 @@ void game_loop()
 	#if LOGGAMELOOP > 0
 	al_trace("game_loop is calling: %s\n", "guys.animate()\n");
 	#endif
-        guys.animate();
+        {
+            frame_phase_timer timer(fpGUYS);
+            guys.animate();
+        }
 	#if LOGGAMELOOP > 0
 	al_trace("game_loop is calling: %s\n", "roaming_item()\n");
 	#endif
@@ -2765,7 +2773,10 @@ void game_loop()
 	#if LOGGAMELOOP > 0
 	al_trace("game_loop is calling: %s\n", "Ewpns.animate()\n");
 	#endif
-        Ewpns.animate();
+        {
+            frame_phase_timer timer(fpWEAPONS);
+            Ewpns.animate();
+        }
 	#if LOGGAMELOOP > 0
 	al_trace("game_loop is setting: %s\n", "checklink=true()\n");
 	#endif
@@ -2780,6 +2791,8 @@ void game_loop()
 	    #if LOGGAMELOOP > 0
 	al_trace("game_loop is at: %s\n", "if(Link.animate(0)\n");
 	#endif
+            frame_phase_timer timer(fpLINK);
+            
             if(Link.animate(0))
             {
                 if(!Quit)
@@ -2799,7 +2812,10 @@ void game_loop()
 	#if LOGGAMELOOP > 0
 	al_trace("game_loop is calling: %s\n", "Lwpns.animate()\n");
 	#endif
-        Lwpns.animate();
+        {
+            frame_phase_timer timer(fpWEAPONS);
+            Lwpns.animate();
+        }
 	#if LOGGAMELOOP > 0
 	al_trace("game_loop is calling: %s\n", "decorations.animate()\n");
 	#endif
@@ -2808,6 +2824,7 @@ void game_loop()
 	al_trace("game_loop is calling: %s\n", "particles.animate()\n");
 	#endif
         particles.animate();
+        animate_pooled_particles();
 	#if LOGGAMELOOP > 0
 	al_trace("game_loop is calling: %s\n", "update_hookshot()\n");
 	#endif
@@ -2843,6 +2860,7 @@ void game_loop()
 	#endif
     if(global_wait)
     {
+        frame_phase_timer timer(fpGLOBALSCRIPT);
         ZScriptVersion::RunScript(SCRIPT_GLOBAL, GLOBAL_SCRIPT_GAME);
         global_wait=false;
     }
@@ -2850,7 +2868,10 @@ void game_loop()
     #if LOGGAMELOOP > 0
 	al_trace("game_loop is calling: %s\n", "draw_screen()\n");
 	#endif
-    draw_screen(tmpscr);
+    {
+        frame_phase_timer timer(fpDRAWSCREEN);
+        draw_screen(tmpscr);
+    }
     
     //clear Link's last hits 
     //for ( int q = 0; q < 4; q++ ) Link.sethitLinkUID(q, 0); //Clearing these here makes checking them fail both before and after waitdraw. 
@@ -3465,6 +3486,7 @@ int onFullscreen()
 int main(int argc, char* argv[])
 {
     bool onlyInstance=true;
+    cache_unpacked_tiles=true;
     
 #ifndef ALLEGRO_MACOSX // Should be done on Mac, too, but I haven't gotten that working
     if(!is_only_instance("zc.lck"))
@@ -3591,6 +3613,15 @@ int main(int argc, char* argv[])
         quit_game();
     }
     
+    // -benchmark runs without a window, input devices or sound
+    int bench_arg = used_switch(argc,argv,"-benchmark");
+    
+    if(bench_arg && (argc>(bench_arg+1)) && atoi(argv[bench_arg+1]) > 0)
+    {
+        headless = true;
+        benchmark_start(atoi(argv[bench_arg+1]));
+    }
+    
     // initialize Allegro
     
     Z_message("Initializing Allegro... ");
@@ -3640,19 +3671,19 @@ int main(int argc, char* argv[])
         quit_game();
     }
     
-    if(install_keyboard() < 0)
+    if(!headless && install_keyboard() < 0)
     {
         Z_error(allegro_error);
         quit_game();
     }
     
-    if(install_mouse() < 0)
+    if(!headless && install_mouse() < 0)
     {
         Z_error(allegro_error);
         quit_game();
     }
     
-    if(install_joystick(JOY_TYPE_AUTODETECT) < 0)
+    if(!headless && install_joystick(JOY_TYPE_AUTODETECT) < 0)
     {
         Z_error(allegro_error);
         quit_game();
@@ -3664,12 +3695,6 @@ int main(int argc, char* argv[])
     LOCK_FUNCTION(update_logic_counter);
     install_int_ex(update_logic_counter, BPS_TO_TIMER(60));
     
-#ifdef _SCRIPT_COUNTER
-    LOCK_VARIABLE(script_counter);
-    LOCK_FUNCTION(update_script_counter);
-    install_int_ex(update_script_counter, 1);
-#endif
-    
     if(!Z_init_timers())
     {
         Z_error("Couldn't Allocate Timers");
@@ -3779,6 +3804,9 @@ int main(int argc, char* argv[])
         }
     }
     
+    if(headless)
+        set_color_depth(8);
+        
     //set_color_depth(32);
    // set_color_conversion(COLORCONV_24_TO_8);
     framebuf  = create_bitmap_ex(8,256,224);
@@ -3853,8 +3881,31 @@ int main(int argc, char* argv[])
         slot_arg2=1;
     }
     
-    int fast_start = debug_enabled || used_switch(argc,argv,"-fast") || (!standalone_mode && (load_save || (slot_arg && (argc>(slot_arg+1)))));
+    // Nobody is there to pick a save at the select screen.
+    if(headless && !load_save && !slot_arg)
+    {
+        Z_error("-benchmark requires a save to play, e.g.\n" \
+                "  -benchmark 3600 -load 1\n" \
+                "  -benchmark 3600 -slot 1");
+    }
+    
+    int fast_start = debug_enabled || headless || used_switch(argc,argv,"-fast") || (!standalone_mode && (load_save || (slot_arg && (argc>(slot_arg+1)))));
     skip_title = used_switch(argc, argv, "-notitle") > 0;
+    
+    if(used_switch(argc,argv,"-profilescripts"))
+        start_script_profiler();
+        
+    if(used_switch(argc,argv,"-frametiming"))
+        start_frame_timing();
+        
+    int replay_arg = used_switch(argc,argv,"-replay");
+    int record_arg = used_switch(argc,argv,"-record");
+    
+    if(replay_arg && (argc>(replay_arg+1)))
+        replay_play(argv[replay_arg+1]);
+    else if(record_arg && (argc>(record_arg+1)))
+        replay_record(argv[record_arg+1]);
+        
     int save_arg = used_switch(argc,argv,"-savefile");
     
     if(save_arg && (argc>(save_arg+1)))
@@ -4115,7 +4166,7 @@ int main(int argc, char* argv[])
     
     Z_message("Initializing sound driver... ");
     
-    if(used_switch(argc,argv,"-s") || used_switch(argc,argv,"-nosound"))
+    if(headless || used_switch(argc,argv,"-s") || used_switch(argc,argv,"-nosound"))
     {
         Z_message("skipped\n");
     }
@@ -4209,7 +4260,15 @@ int main(int argc, char* argv[])
     
     screen_scale = zc_max(zc_min(resx / 320, resy / 240), 1);
     
-    if(!game_vid_mode(tempmode, wait_ms_on_set_graphics))
+    if(headless)
+    {
+        // The game still draws to framebuf; updatescr() just doesn't show it.
+        resx = 320;
+        resy = 240;
+        screen_scale = 1;
+        screen = create_bitmap_ex(8, resx, resy);
+    }
+    else if(!game_vid_mode(tempmode, wait_ms_on_set_graphics))
     {
         //what we need here is not rightousness but madness!!!
         
@@ -4271,7 +4330,11 @@ int main(int argc, char* argv[])
     
     real_screen = screen;
     
-    if(Triplebuffer.GFX_can_triple_buffer())
+    if(headless)
+    {
+        triplebuffer_not_available = true;
+    }
+    else if(Triplebuffer.GFX_can_triple_buffer())
     {
         Triplebuffer.Create();
     }
@@ -4285,7 +4348,7 @@ int main(int argc, char* argv[])
     gui_mouse_focus = FALSE;
     position_mouse(resx-16,resy-16);
     
-    if(!onlyInstance)
+    if(!onlyInstance && !headless)
     {
         clear_to_color(screen,BLACK);
         system_pal();
@@ -4378,8 +4441,14 @@ int main(int argc, char* argv[])
             }
             
 #endif
+            if(headless)
+                benchmark_frame_start();
+                
             game_loop();
             advanceframe(true);
+            
+            if(headless && benchmark_frame_end())
+                Quit=qEXIT;
 		
 	     //clear Link's last hits 
 	     //for ( int q = 0; q < 4; q++ ) Link.sethitLinkUID(q, 0); //clearing this here makes it impossible 
@@ -4389,6 +4458,10 @@ int main(int argc, char* argv[])
         tmpscr->flags3=0;
         Playing=Paused=false;
         
+        // Game over and the ending wait for input that won't come.
+        if(headless)
+            break;
+            
         switch(Quit)
         {
         case qQUIT:
@@ -4492,9 +4565,17 @@ quick_quit:
 	{
 		pan_style = (long)FFCore.usr_panstyle;
 	}
-    show_saving(screen);
-    save_savedgames();
-    save_game_configs();
+    if(headless)
+    {
+        benchmark_report();
+    }
+    else
+    {
+        show_saving(screen);
+        save_savedgames();
+        save_game_configs();
+    }
+    
     Triplebuffer.Destroy();
     set_gfx_mode(GFX_TEXT,80,25,0,0);
     //rest(250); // ???
@@ -4521,9 +4602,6 @@ void remove_installed_timers()
     al_trace("Removing timers. \n");
     remove_int(update_logic_counter);
     Z_remove_timers();
-#ifdef _SCRIPT_COUNTER
-    remove_int(update_script_counter);
-#endif
     
 }
 
@@ -4539,6 +4617,9 @@ void delete_everything_else() //blarg.
 
 void quit_game()
 {
+    stop_script_profiler();
+    stop_frame_timing();
+    replay_stop();
     script_drawing_commands.Dispose(); //for allegro bitmaps
     
     remove_installed_timers();
@@ -4621,6 +4702,8 @@ void quit_game()
     
     al_trace("Script buffers... \n");
     
+    clear_decoded_scripts();
+    
     for(int i=0; i<512; i++)
     {
         if(ffscripts[i]!=NULL) delete [] ffscripts[i];
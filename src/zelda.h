@@ -301,10 +301,10 @@ extern int draw_screen_clip_rect_y2;
 extern tiledata *newtilebuf, *grabtilebuf;
 extern newcombo *combobuf;
 extern word animated_combo_table[MAXCOMBOS][2];             //[0]=position in act2, [1]=original tile
-extern word animated_combo_table4[MAXCOMBOS][2];            //[0]=combo, [1]=clock
+extern word animated_combo_table4[MAXCOMBOS][2];            //[0]=combo, [1]=frame the clock was reset
 extern word animated_combos;
 extern word animated_combo_table2[MAXCOMBOS][2];             //[0]=position in act2, [1]=original tile
-extern word animated_combo_table24[MAXCOMBOS][2];            //[0]=combo, [1]=clock
+extern word animated_combo_table24[MAXCOMBOS][2];            //[0]=combo, [1]=frame the clock was reset
 extern word animated_combos2;
 extern bool blank_tile_table[NEWMAXTILES];                  //keeps track of blank tiles
 extern bool blank_tile_quarters_table[NEWMAXTILES*4];       //keeps track of blank tiles
@@ -328,9 +328,6 @@ extern int    Bpos;
 extern byte screengrid[22];
 extern byte ffcgrid[4];
 extern volatile int logic_counter;
-#ifdef _SCRIPT_COUNTER
-extern volatile int script_counter;
-#endif
 extern bool halt;
 extern bool screenscrolling;
 extern bool close_button_quit;
@@ -342,10 +339,6 @@ extern byte frame_rest_suggest, forceExit, zc_vsync;
 extern byte zc_color_depth;
 extern byte use_debug_console, use_win32_proc; //windows only
 
-#ifdef _SCRIPT_COUNTER
-void update_script_counter();
-#endif
-
 extern PALETTE tempbombpal;
 extern bool usebombpal;
 
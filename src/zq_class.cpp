@@ -20,6 +20,7 @@
 
 #include <string.h>
 #include <string>
+#include <algorithm>
 #include <stdexcept>
 #include <map>
 
@@ -94,7 +95,8 @@ mapscr* zmap::get_prvscr()
 
 zmap::zmap()
 {
-    can_undo=can_paste=false;
+    can_paste=false;
+    undo_copies=0;
     prv_cmbcycle=0;
     prv_advance=0;
     prv_freeze=0;
@@ -118,11 +120,12 @@ zmap::zmap()
 }
 zmap::~zmap()
 {
+    ClearUndo();
 }
 
 bool zmap::CanUndo()
 {
-    return can_undo;
+    return !undo_steps.empty();
 }
 bool zmap::CanPaste()
 {
@@ -561,7 +564,6 @@ bool zmap::isDark()
 }
 void zmap::setCurrMap(int index)
 {
-    int oldmap=currmap;
     scrpos[currmap]=currscr;
     currmap=bound(index,0,map_count);
     screens=&TheMaps[currmap*MAPSCRS];
@@ -569,11 +571,6 @@ void zmap::setCurrMap(int index)
     currscr=scrpos[currmap];
     loadlvlpal(getcolor());
     
-    if(currmap!=oldmap)
-    {
-        can_undo=false;
-    }
-    
     reset_combo_animations2();
 }
 
@@ -585,7 +582,6 @@ void zmap::setCurrScr(int scr)
 {
     if(scr==currscr) return;
     
-    int oldscr=currscr;
     int oldcolor=getcolor();
     
     if(!(screens[currscr].valid&mVALID))
@@ -608,11 +604,6 @@ void zmap::setCurrScr(int scr)
         rebuild_trans_table();
     }
     
-    if(currscr!=oldscr)
-    {
-        can_undo=false;
-    }
-    
     reset_combo_animations2();
     setlayertarget();
 }
@@ -3755,56 +3746,167 @@ void zmap::putdoor(int scr,int side,int door)
     }
 }
 
-void zmap::Ugo()
+// Undo keeps at most this many steps, and drops the oldest steps once
+// their screen copies add up to more than UNDO_SCREENS.
+#define UNDO_LEVELS  100
+#define UNDO_SCREENS 1024
+
+// Everything in a mapscr apart from the combo vectors is plain data, so it
+// is copied byte for byte, padding included. That makes a fresh copy compare
+// equal to its screen for as long as the screen is left alone.
+static void copy_undo_screen(mapscr *dest, const mapscr *src)
 {
-    mapscr *layer;
-    int layermap, layerscreen;
-    layer=AbsoluteScr(currmap,currscr);
+    size_t head=(const char *)&src->data-(const char *)src;
+    size_t tail=(const char *)&src->viewX-(const char *)src;
+    memcpy((char *)dest, (const char *)src, head);
+    memcpy((char *)dest+tail, (const char *)src+tail, sizeof(mapscr)-tail);
+    dest->data=src->data;
+    dest->sflag=src->sflag;
+    dest->cset=src->cset;
+}
+
+static bool same_undo_screen(const mapscr *a, const mapscr *b)
+{
+    size_t head=(const char *)&a->data-(const char *)a;
+    size_t tail=(const char *)&a->viewX-(const char *)a;
+    return memcmp((const char *)a, (const char *)b, head)==0
+           && memcmp((const char *)a+tail, (const char *)b+tail, sizeof(mapscr)-tail)==0
+           && a->data==b->data && a->sflag==b->sflag && a->cset==b->cset;
+}
+
+void zmap::undo_screens(const std::vector<int> &touched)
+{
+    undo_step step;
+    step.map=currmap;
+    step.scr=currscr;
     
-    for(int x=0; x<MAPSCRS; x++)
+    for(size_t i=0; i<touched.size(); ++i)
     {
-        copy_mapscr(&undomap[x], &screens[x]);
+        int index=touched[i];
+        undo_copy *copy=NULL;
+        
+        // Share the newest copy of this screen if nothing has changed since.
+        for(std::deque<undo_step>::reverse_iterator it=undo_steps.rbegin(); it!=undo_steps.rend() && !copy; ++it)
+        {
+            for(size_t j=0; j<it->screens.size(); ++j)
+            {
+                if(it->screens[j].first==index)
+                {
+                    copy=it->screens[j].second;
+                    break;
+                }
+            }
+        }
+        
+        if(copy && same_undo_screen(&copy->scr, &TheMaps[index]))
+        {
+            ++copy->refs;
+        }
+        else
+        {
+            copy=new undo_copy;
+            copy_undo_screen(&copy->scr, &TheMaps[index]);
+            copy->refs=1;
+            ++undo_copies;
+        }
+        
+        step.screens.push_back(std::make_pair(index, copy));
     }
     
-    for(int k=0; k<6; ++k)
+    undo_steps.push_back(step);
+    
+    while(undo_steps.size()>UNDO_LEVELS || (undo_copies>UNDO_SCREENS && undo_steps.size()>1))
     {
-        undomap[MAPSCRS+k].zero_memory();
-        layermap=layer->layermap[k]-1;
+        release_undo_step(undo_steps.front());
+        undo_steps.pop_front();
+    }
+}
+
+void zmap::release_undo_step(undo_step &step)
+{
+    for(size_t i=0; i<step.screens.size(); ++i)
+    {
+        undo_copy *copy=step.screens[i].second;
         
-        if(layermap>-1 && layermap<map_count)
+        if(--copy->refs==0)
         {
-            layerscreen=layer->layerscreen[k];
-            copy_mapscr(&undomap[MAPSCRS+k], AbsoluteScr(layermap,layerscreen));
+            delete copy;
+            --undo_copies;
         }
     }
     
-    can_undo=true;
+    step.screens.clear();
 }
 
-void zmap::Uhuilai()
+// Saves the current screen and its layers ahead of an edit.
+void zmap::Ugo()
 {
-    mapscr *layer;
-    int layermap, layerscreen;
-    layer=AbsoluteScr(currmap,currscr);
+    std::vector<int> touched;
+    mapscr *layer=AbsoluteScr(currmap,currscr);
+    touched.push_back(currmap*MAPSCRS+currscr);
     
-    if(can_undo)
+    for(int k=0; k<6; ++k)
     {
-        for(int x=0; x<MAPSCRS; x++)
-        {
-            zc_swap(screens[x],undomap[x]);
-        }
+        int layermap=layer->layermap[k]-1;
         
-        for(int k=0; k<6; ++k)
+        if(layermap>-1 && layermap<map_count)
         {
-            layermap=layer->layermap[k]-1;
+            int index=layermap*MAPSCRS+layer->layerscreen[k];
             
-            if(layermap>-1 && layermap<map_count)
-            {
-                layerscreen=layer->layerscreen[k];
-                zc_swap(*AbsoluteScr(layermap,layerscreen),undomap[MAPSCRS+k]);
-            }
+            if(std::find(touched.begin(), touched.end(), index)==touched.end())
+                touched.push_back(index);
         }
     }
+    
+    undo_screens(touched);
+}
+
+// Saves every screen on the current map, for edits that reach beyond the
+// current screen.
+void zmap::UgoMap()
+{
+    std::vector<int> touched;
+    
+    for(int x=0; x<MAPSCRS; x++)
+        touched.push_back(currmap*MAPSCRS+x);
+        
+    undo_screens(touched);
+}
+
+void zmap::Uhuilai()
+{
+    if(undo_steps.empty())
+        return;
+        
+    undo_step &step=undo_steps.back();
+    
+    for(size_t i=0; i<step.screens.size(); ++i)
+    {
+        if(step.screens[i].first<(int)TheMaps.size())
+            copy_undo_screen(&TheMaps[step.screens[i].first], &step.screens[i].second->scr);
+    }
+    
+    int map=step.map, scr=step.scr;
+    release_undo_step(step);
+    undo_steps.pop_back();
+    
+    // Go back to where the edit was made.
+    if(map<map_count)
+    {
+        if(map!=currmap)
+            setCurrMap(map);
+            
+        setCurrScr(scr);
+    }
+}
+
+void zmap::ClearUndo()
+{
+    while(!undo_steps.empty())
+    {
+        release_undo_step(undo_steps.back());
+        undo_steps.pop_back();
+    }
 }
 
 void zmap::Copy()
@@ -4180,7 +4282,7 @@ void zmap::PasteToAll()
 {
     if(can_paste)
     {
-        Ugo();
+        UgoMap();
         int oldcolor=getcolor();
         
         for(int x=0; x<128; x++)
@@ -4225,7 +4327,7 @@ void zmap::PasteAllToAll()
 {
     if(can_paste)
     {
-        Ugo();
+        UgoMap();
         int oldcolor=getcolor();
         
         for(int x=0; x<128; x++)
@@ -4267,7 +4369,12 @@ void zmap::setCanUndo(bool _set)
 
 void zmap::setCanPaste(bool _set)
 {
-    can_undo=can_undo_map=_set;
+    can_undo_map=_set;
+    
+    if(!_set)
+    {
+        ClearUndo();
+    }
 }
 
 void zmap::update_combo_cycling()
@@ -4295,7 +4402,7 @@ void zmap::update_combo_cycling()
         y=animated_combo_table[x][0];
         
         //time to restart
-        if((animated_combo_table4[y][1]>=combobuf[x].speed) &&
+        if((combo_animation_clock(y)>=combobuf[x].speed) &&
                 (combobuf[x].tile-combobuf[x].frames>=animated_combo_table[x][1]-1) &&
                 (combobuf[x].nextcombo!=0))
         {
@@ -4316,7 +4423,7 @@ void zmap::update_combo_cycling()
         y=animated_combo_table2[x][0];
         
         //time to restart
-        if((animated_combo_table24[y][1]>=combobuf[x].speed) &&
+        if((combo_animation_clock2(y)>=combobuf[x].speed) &&
                 (combobuf[x].tile-combobuf[x].frames>=animated_combo_table2[x][1]-1) &&
                 (combobuf[x].nextcombo!=0))
         {
@@ -4349,7 +4456,7 @@ void zmap::update_combo_cycling()
         y=animated_combo_table[x][0];
         
         //time to restart
-        if((animated_combo_table4[y][1]>=combobuf[x].speed) &&
+        if((combo_animation_clock(y)>=combobuf[x].speed) &&
                 (combobuf[x].tile-combobuf[x].frames>=animated_combo_table[x][1]-1) &&
                 (combobuf[x].nextcombo!=0))
         {
@@ -4370,7 +4477,7 @@ void zmap::update_combo_cycling()
         y=animated_combo_table2[x][0];
         
         //time to restart
-        if((animated_combo_table24[y][1]>=combobuf[x].speed) &&
+        if((combo_animation_clock2(y)>=combobuf[x].speed) &&
                 (combobuf[x].tile-combobuf[x].frames>=animated_combo_table2[x][1]-1) &&
                 (combobuf[x].nextcombo!=0))
         {
@@ -4410,7 +4517,7 @@ void zmap::update_combo_cycling()
                 y=animated_combo_table[x][0];
                 
                 //time to restart
-                if((animated_combo_table4[y][1]>=combobuf[x].speed) &&
+                if((combo_animation_clock(y)>=combobuf[x].speed) &&
                         (combobuf[x].tile-combobuf[x].frames>=animated_combo_table[x][1]-1)	&&
                         (combobuf[x].nextcombo!=0))
                 {
@@ -4431,7 +4538,7 @@ void zmap::update_combo_cycling()
                 y=animated_combo_table2[x][0];
                 
                 //time to restart
-                if((animated_combo_table24[y][1]>=combobuf[x].speed) &&
+                if((combo_animation_clock2(y)>=combobuf[x].speed) &&
                         (combobuf[x].tile-combobuf[x].frames>=animated_combo_table2[x][1]-1) &&
                         (combobuf[x].nextcombo!=0))
                 {
@@ -4462,13 +4569,13 @@ void zmap::update_combo_cycling()
         if(restartanim[i])
         {
             combobuf[i].tile = animated_combo_table[i][1];
-            animated_combo_table4[animated_combo_table[i][0]][1]=0;
+            reset_combo_animation_clock(animated_combo_table[i][0]);
         }
         
         if(restartanim2[i])
         {
             combobuf[i].tile = animated_combo_table2[i][1];
-            animated_combo_table4[animated_combo_table[i][0]][1]=0;
+            reset_combo_animation_clock(animated_combo_table[i][0]);
         }
     }
     
@@ -5990,6 +6097,9 @@ int load_quest(const char *filename, bool compressed, bool encrypted)
         skip_flags[i]=0;
     }
     
+    // The undo journal refers to screens of the quest being replaced.
+    Map.ClearUndo();
+    
     int ret=loadquest(filename,&header,&misc,customtunes,true,compressed,encrypted,true,skip_flags);
 //  setPackfilePassword(NULL);
 
@@ -13,6 +13,9 @@
 
 #include "zdefs.h"
 #include <stdio.h>
+#include <deque>
+#include <utility>
+#include <vector>
 
 #define COMBOPOS(x,y) (((y)&0xF0)+((x)>>4))
 #define COMBOX(pos) ((pos)%16*16)
@@ -36,12 +39,30 @@ class zmap
     int scrpos[MAXMAPS2+1];
     
     mapscr copymapscr;
-    mapscr undomap[MAPSCRS+6];
+    
+    // Undo journal. Each step holds copies of the screens an edit could
+    // touch, taken just before it. A copy that still matches its screen is
+    // shared with the next step instead of being made again.
+    struct undo_copy
+    {
+        mapscr scr;
+        int refs;
+    };
+    struct undo_step
+    {
+        int map, scr; // Where the edit was made
+        std::vector<std::pair<int, undo_copy*> > screens; // By TheMaps index
+    };
+    std::deque<undo_step> undo_steps;
+    int undo_copies;
+    void undo_screens(const std::vector<int> &touched);
+    void release_undo_step(undo_step &step);
+    
     mapscr prvscr; //NEW
     mapscr prvlayers[6];
     //int prv_mode; //NEW
     int prv_cmbcycle, prv_map, prv_scr, prv_freeze, prv_advance, prv_time; //NEW
-    bool can_undo,can_paste,can_undo_map,can_paste_map,screen_copy;
+    bool can_paste,can_undo_map,can_paste_map,screen_copy;
     // A screen which uses the current screen as a layer
     int layer_target_map, layer_target_scr, layer_target_multiple;
     
@@ -54,7 +75,9 @@ public:
     int  CopyScr();
     int  getCopyFFC();
     void Ugo();
+    void UgoMap();
     void Uhuilai();
+    void ClearUndo();
     void Copy();
     void CopyFFC(int n);
     void Paste();
@@ -236,6 +236,7 @@ int mouse_scroll_h;
 
 int readsize, writesize;
 bool fake_pack_writing=false;
+PACKFILE *uncounted_pack=NULL;
 
 int showxypos_x;
 int showxypos_y;
@@ -579,6 +579,69 @@ int encode_file_007(const char *srcfile, const char *destfile, int key2, const c
     return 0;
 }
 
+//
+// Same as encode_file_007(), but encodes 'size' bytes at 'src' into a
+// zc_malloc'd buffer returned through *dest and *destsize.
+//
+int encode_memory_007(const byte *src, long size, byte **dest, long *destsize, int key2, const char *header, int method)
+{
+    long hlen = header ? (long)strlen(header) : 0;
+    byte *out = (byte *)zc_malloc(hlen + 4 + size + 4);
+    
+    if(!out)
+    {
+        return 2;
+    }
+    
+    byte *p = out;
+    int r = 0;
+    short c1 = 0, c2 = 0;
+    
+    seed = key2;
+    
+    // write the header
+    memcpy(p, header, hlen);
+    p += hlen;
+    
+    // write the key, XORed with MASK
+    key2 ^= enc_mask[method];
+    *(p++) = key2>>24;
+    *(p++) = (key2>>16)&255;
+    *(p++) = (key2>>8)&255;
+    *(p++) = key2&255;
+    
+    // encode the data
+    for(long i = 0; i < size; i++)
+    {
+        int c = src[i];
+        c1 += c;
+        c2 = (c2 << 4) + (c2 >> 12) + c;
+        
+        if(i & 1)
+            c += r;
+        else
+        {
+            r = rand_007(method);
+            c ^= r;
+        }
+        
+        *(p++) = c;
+    }
+    
+    // write the checksums
+    r = rand_007(method);
+    c1 ^= r;
+    c2 += r;
+    *(p++) = c1>>8;
+    *(p++) = c1&255;
+    *(p++) = c2>>8;
+    *(p++) = c2&255;
+    
+    *dest = out;
+    *destsize = p - out;
+    return 0;
+}
+
 //
 // RETURNS:
 //   0 - OK
@@ -901,6 +964,765 @@ error:
     return err;
 }
 
+//
+// Same as decode_file_007(), but decodes into memory instead of a temp
+// file. The file is read once; if its checksums don't match 'method', the
+// older methods are tried in turn on the buffer. On success *dest points
+// to the decoded data (zc_malloc'd) and *destsize holds its length.
+//
+// RETURNS: as decode_file_007(), except that 5 means no method matched.
+//
+int decode_file_007_to_memory(const char *srcfile, byte **dest, long *destsize, const char *header, int method, bool packed, const char *password)
+{
+    *dest = NULL;
+    *destsize = 0;
+    
+    long size = file_size_ex_password(srcfile, password);
+    
+    if(size < 1)
+    {
+        return 1;
+    }
+    
+    if(size - 8 < 1)
+    {
+        return 3;
+    }
+    
+    byte *src = (byte *)zc_malloc(size);
+    
+    if(!src)
+    {
+        return 2;
+    }
+    
+    long got = 0;
+    
+    if(packed)
+    {
+        PACKFILE *f = pack_fopen_password(srcfile, F_READ_PACKED, password);
+        
+        if(errno==EDOM)
+        {
+            f = pack_fopen_password(srcfile, F_READ, password);
+        }
+        
+        if(!f)
+        {
+            zc_free(src);
+            return 1;
+        }
+        
+        got = pack_fread(src, size, f);
+        pack_fclose(f);
+    }
+    else
+    {
+        FILE *f = fopen(srcfile, "rb");
+        
+        if(!f)
+        {
+            zc_free(src);
+            return 1;
+        }
+        
+        got = (long)fread(src, 1, size, f);
+        fclose(f);
+    }
+    
+    long hlen = header ? (long)strlen(header) : 0;
+    
+    if(got < size || size < hlen + 8)
+    {
+        zc_free(src);
+        return 4;
+    }
+    
+    if(hlen && memcmp(src, header, hlen) != 0)
+    {
+        zc_free(src);
+        return 6;
+    }
+    
+    const byte *key = src + hlen;
+    const byte *data = key + 4;
+    const long datasize = size - hlen - 8;
+    const byte *checks = data + datasize;
+    const int key2 = (key[0] << 24) + (key[1] << 16) + (key[2] << 8) + key[3];
+    byte *out = (byte *)zc_malloc(datasize);
+    
+    if(!out)
+    {
+        zc_free(src);
+        return 2;
+    }
+    
+    for(int m = method; m >= 0; --m)
+    {
+        short c1 = 0, c2 = 0, check1, check2;
+        int r = 0;
+        seed = key2 ^ enc_mask[m];
+        
+        for(long i = 0; i < datasize; i++)
+        {
+            byte c;
+            
+            if(i & 1)
+            {
+                c = data[i] - r;
+            }
+            else
+            {
+                r = rand_007(m);
+                c = data[i] ^ r;
+            }
+            
+            out[i] = c;
+            c1 += c;
+            c2 = (c2 << 4) + (c2 >> 12) + c;
+        }
+        
+        r = rand_007(m);
+        check1 = ((checks[0] << 8) + checks[1]) ^ r;
+        check2 = ((checks[2] << 8) + checks[3]) - r;
+        
+        if(check1 == c1 && check2 == c2)
+        {
+            zc_free(src);
+            *dest = out;
+            *destsize = datasize;
+            return 0;
+        }
+    }
+    
+    zc_free(src);
+    zc_free(out);
+    return 5;
+}
+
+/**********  In-memory packfiles  *****************/
+
+// A decoded file held in memory, read through a PACKFILE vtable.
+struct memory_packfile
+{
+    byte *base; // what to free on close
+    byte *buf;
+    long size, pos;
+};
+
+// LZSS packed data on top of a memory_packfile.
+struct lzss_memory_packfile
+{
+    PACKFILE *raw;
+    LZSS_UNPACK_DATA *unpack;
+    byte out[F_BUF_SIZE];
+    int outpos, outlen;
+    bool done;
+};
+
+static int mem_fclose(void *userdata)
+{
+    memory_packfile *mf = (memory_packfile *)userdata;
+    zc_free(mf->base);
+    delete mf;
+    return 0;
+}
+
+static int mem_getc(void *userdata)
+{
+    memory_packfile *mf = (memory_packfile *)userdata;
+    return mf->pos < mf->size ? mf->buf[mf->pos++] : EOF;
+}
+
+static int mem_ungetc(int c, void *userdata)
+{
+    memory_packfile *mf = (memory_packfile *)userdata;
+    
+    if(mf->pos <= 0 || mf->buf[mf->pos-1] != (byte)c)
+        return EOF;
+        
+    --mf->pos;
+    return c;
+}
+
+static long mem_fread(void *p, long n, void *userdata)
+{
+    memory_packfile *mf = (memory_packfile *)userdata;
+    
+    if(n > mf->size - mf->pos)
+        n = mf->size - mf->pos;
+        
+    memcpy(p, mf->buf + mf->pos, n);
+    mf->pos += n;
+    return n;
+}
+
+static int mem_fseek(void *userdata, int offset)
+{
+    memory_packfile *mf = (memory_packfile *)userdata;
+    
+    if(offset < 0 || offset > mf->size - mf->pos)
+        return -1;
+        
+    mf->pos += offset;
+    return 0;
+}
+
+static int mem_feof(void *userdata)
+{
+    memory_packfile *mf = (memory_packfile *)userdata;
+    return mf->pos >= mf->size;
+}
+
+static int lzss_fill(lzss_memory_packfile *lf)
+{
+    if(lf->outpos < lf->outlen)
+        return 1;
+        
+    if(lf->done)
+        return 0;
+        
+    lf->outpos = 0;
+    lf->outlen = lzss_read(lf->raw, lf->unpack, F_BUF_SIZE, lf->out);
+    
+    if(lf->outlen < F_BUF_SIZE)
+        lf->done = true;
+        
+    return lf->outlen > 0;
+}
+
+static int lzss_fclose(void *userdata)
+{
+    lzss_memory_packfile *lf = (lzss_memory_packfile *)userdata;
+    pack_fclose(lf->raw);
+    free_lzss_unpack_data(lf->unpack);
+    delete lf;
+    return 0;
+}
+
+static int lzss_getc(void *userdata)
+{
+    lzss_memory_packfile *lf = (lzss_memory_packfile *)userdata;
+    return lzss_fill(lf) ? lf->out[lf->outpos++] : EOF;
+}
+
+static int lzss_ungetc(int c, void *userdata)
+{
+    lzss_memory_packfile *lf = (lzss_memory_packfile *)userdata;
+    
+    if(lf->outpos <= 0)
+        return EOF;
+        
+    lf->out[--lf->outpos] = (byte)c;
+    return c;
+}
+
+static long lzss_fread(void *p, long n, void *userdata)
+{
+    lzss_memory_packfile *lf = (lzss_memory_packfile *)userdata;
+    long got = 0;
+    
+    while(got < n && lzss_fill(lf))
+    {
+        long chunk = zc_min(n - got, (long)(lf->outlen - lf->outpos));
+        memcpy((byte *)p + got, lf->out + lf->outpos, chunk);
+        lf->outpos += chunk;
+        got += chunk;
+    }
+    
+    return got;
+}
+
+static int lzss_fseek(void *userdata, int offset)
+{
+    lzss_memory_packfile *lf = (lzss_memory_packfile *)userdata;
+    
+    while(offset > 0 && lzss_fill(lf))
+    {
+        int chunk = zc_min(offset, lf->outlen - lf->outpos);
+        lf->outpos += chunk;
+        offset -= chunk;
+    }
+    
+    return offset ? -1 : 0;
+}
+
+static int lzss_feof(void *userdata)
+{
+    return !lzss_fill((lzss_memory_packfile *)userdata);
+}
+
+static int mem_putc(int, void *)
+{
+    return EOF;
+}
+
+static long mem_fwrite(AL_CONST void *, long, void *)
+{
+    return 0;
+}
+
+static int mem_ferror(void *)
+{
+    return 0;
+}
+
+static PACKFILE_VTABLE memory_vtable =
+{
+    mem_fclose, mem_getc, mem_ungetc, mem_fread, mem_putc, mem_fwrite, mem_fseek, mem_feof, mem_ferror
+};
+
+static PACKFILE_VTABLE lzss_memory_vtable =
+{
+    lzss_fclose, lzss_getc, lzss_ungetc, lzss_fread, mem_putc, mem_fwrite, lzss_fseek, lzss_feof, mem_ferror
+};
+
+// Allegro's encrypt_id(): the packfile magic numbers are masked with the password.
+static long packfile_magic(long magic, const char *password, bool new_format)
+{
+    long mask = 0;
+    
+    if(password[0])
+    {
+        int i, pos;
+        
+        for(i=0; password[i]; i++)
+            mask ^= ((long)password[i] << ((i&3) * 8));
+            
+        for(i=0, pos=0; i<4; i++)
+        {
+            mask ^= (long)password[pos++] << (24-i*8);
+            
+            if(!password[pos])
+                pos = 0;
+        }
+        
+        if(new_format)
+            mask ^= 42;
+    }
+    
+    return (magic ^ mask) & 0xFFFFFFFFL;
+}
+
+static void packfile_xor(byte *buf, long size, const char *password)
+{
+    if(!password[0])
+        return;
+        
+    const char *pw = password;
+    
+    for(long i = 0; i < size; i++)
+    {
+        buf[i] ^= *(pw++);
+        
+        if(!*pw)
+            pw = password;
+    }
+}
+
+static PACKFILE *open_memory_packfile(byte *base, byte *buf, long size)
+{
+    memory_packfile *mf = new memory_packfile;
+    mf->base = base;
+    mf->buf = buf;
+    mf->size = size;
+    mf->pos = 0;
+    
+    PACKFILE *f = pack_fopen_vtable(&memory_vtable, mf);
+    
+    if(!f)
+        delete mf;
+        
+    return f;
+}
+
+// Collects a file being written in memory.
+struct memory_write_packfile
+{
+    byte **dest;
+    long *destsize;
+    byte *buf;
+    long size, capacity;
+    bool error;
+};
+
+// LZSS packs a file being written on top of a memory_write_packfile.
+struct lzss_write_packfile
+{
+    PACKFILE *raw;
+    LZSS_PACK_DATA *pack;
+    byte in[F_BUF_SIZE];
+    int insize;
+    bool error;
+};
+
+static int memw_fclose(void *userdata)
+{
+    memory_write_packfile *mf = (memory_write_packfile *)userdata;
+    int ret = mf->error ? -1 : 0;
+    
+    if(mf->error)
+    {
+        zc_free(mf->buf);
+        mf->buf = NULL;
+        mf->size = 0;
+    }
+    
+    *mf->dest = mf->buf;
+    *mf->destsize = mf->size;
+    delete mf;
+    return ret;
+}
+
+static long memw_fwrite(AL_CONST void *p, long n, void *userdata)
+{
+    memory_write_packfile *mf = (memory_write_packfile *)userdata;
+    
+    if(mf->error)
+        return 0;
+        
+    if(mf->size + n > mf->capacity)
+    {
+        long capacity = zc_max(mf->capacity * 2, mf->size + n);
+        byte *grown = (byte *)zc_malloc(capacity);
+        
+        if(!grown)
+        {
+            mf->error = true;
+            return 0;
+        }
+        
+        memcpy(grown, mf->buf, mf->size);
+        zc_free(mf->buf);
+        mf->buf = grown;
+        mf->capacity = capacity;
+    }
+    
+    memcpy(mf->buf + mf->size, p, n);
+    mf->size += n;
+    return n;
+}
+
+static int memw_putc(int c, void *userdata)
+{
+    byte b = (byte)c;
+    return memw_fwrite(&b, 1, userdata) == 1 ? (c & 255) : EOF;
+}
+
+static int memw_ferror(void *userdata)
+{
+    return ((memory_write_packfile *)userdata)->error;
+}
+
+static int lzssw_flush(lzss_write_packfile *lf, int last)
+{
+    if(lf->insize > 0 && !lf->error)
+    {
+        if(lzss_write(lf->raw, lf->pack, lf->insize, lf->in, last))
+            lf->error = true;
+    }
+    
+    lf->insize = 0;
+    return lf->error ? -1 : 0;
+}
+
+static int lzssw_fclose(void *userdata)
+{
+    lzss_write_packfile *lf = (lzss_write_packfile *)userdata;
+    
+    if(lzssw_flush(lf, 1))
+        ((memory_write_packfile *)lf->raw->userdata)->error = true;
+        
+    free_lzss_pack_data(lf->pack);
+    int ret = pack_fclose(lf->raw);
+    delete lf;
+    return ret;
+}
+
+static int lzssw_putc(int c, void *userdata)
+{
+    lzss_write_packfile *lf = (lzss_write_packfile *)userdata;
+    
+    // Flushed one byte early, as Allegro does, so there's always
+    // something left to pack as the last block.
+    if(lf->insize + 1 >= F_BUF_SIZE && lzssw_flush(lf, 0))
+        return EOF;
+        
+    lf->in[lf->insize++] = (byte)c;
+    return c & 255;
+}
+
+static long lzssw_fwrite(AL_CONST void *p, long n, void *userdata)
+{
+    const byte *cp = (const byte *)p;
+    
+    for(long i = 0; i < n; i++)
+    {
+        if(lzssw_putc(cp[i], userdata) == EOF)
+            return i;
+    }
+    
+    return n;
+}
+
+static int lzssw_ferror(void *userdata)
+{
+    return ((lzss_write_packfile *)userdata)->error;
+}
+
+static int memw_getc(void *)
+{
+    return EOF;
+}
+
+static int memw_ungetc(int, void *)
+{
+    return EOF;
+}
+
+static long memw_fread(void *, long, void *)
+{
+    return 0;
+}
+
+static int memw_fseek(void *, int)
+{
+    return -1;
+}
+
+static int memw_feof(void *)
+{
+    return 1;
+}
+
+static PACKFILE_VTABLE memory_write_vtable =
+{
+    memw_fclose, memw_getc, memw_ungetc, memw_fread, memw_putc, memw_fwrite, memw_fseek, memw_feof, memw_ferror
+};
+
+static PACKFILE_VTABLE lzss_write_vtable =
+{
+    lzssw_fclose, memw_getc, memw_ungetc, memw_fread, lzssw_putc, lzssw_fwrite, memw_fseek, memw_feof, lzssw_ferror
+};
+
+//
+// Opens a PACKFILE that collects what's written to it in memory, LZSS
+// packed the way F_WRITE_PACKED (with no password) would pack it if
+// 'packed' is set. When it's closed, *dest is set to the data, which the
+// caller frees with zc_free(), and *destsize to its length; on an error
+// pack_fclose() returns nonzero and *dest is NULL.
+//
+PACKFILE *pack_fopen_memory_write(byte **dest, long *destsize, bool packed)
+{
+    *dest = NULL;
+    *destsize = 0;
+    
+    memory_write_packfile *mf = new memory_write_packfile;
+    mf->dest = dest;
+    mf->destsize = destsize;
+    mf->buf = NULL;
+    mf->size = mf->capacity = 0;
+    mf->error = false;
+    
+    PACKFILE *raw = pack_fopen_vtable(&memory_write_vtable, mf);
+    
+    if(!raw)
+    {
+        delete mf;
+        return NULL;
+    }
+    
+    if(!packed)
+        return raw;
+        
+    lzss_write_packfile *lf = new lzss_write_packfile;
+    lf->raw = raw;
+    lf->pack = create_lzss_pack_data();
+    lf->insize = 0;
+    lf->error = false;
+    pack_mputl(F_PACK_MAGIC, raw);
+    
+    PACKFILE *f = lf->pack ? pack_fopen_vtable(&lzss_write_vtable, lf) : NULL;
+    
+    if(!f)
+    {
+        if(lf->pack)
+            free_lzss_pack_data(lf->pack);
+            
+        delete lf;
+        pack_fclose(raw);
+        zc_free(*dest);
+        *dest = NULL;
+        *destsize = 0;
+    }
+    
+    return f;
+}
+
+//
+// Writes 'size' bytes to 'filename' in one go. The data goes to a
+// temporary file next to it first, which then replaces the original, so
+// a failed write leaves the old file alone.
+//
+bool write_file_atomic(const char *filename, const void *data, long size)
+{
+    char tmpname[2048];
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+    tmpname[sizeof(tmpname)-1] = 0;
+    
+    FILE *f = fopen(tmpname, "wb");
+    
+    if(!f)
+        return false;
+        
+    bool ok = fwrite(data, 1, size, f) == size_t(size);
+    
+    if(fclose(f) != 0)
+        ok = false;
+        
+    if(!ok)
+    {
+        delete_file(tmpname);
+        return false;
+    }
+    
+#ifdef ALLEGRO_WINDOWS
+    // rename() won't replace an existing file here, so the original is
+    // moved aside first and put back if the new file can't take its place.
+    char bakname[2048];
+    snprintf(bakname, sizeof(bakname), "%s.bak", filename);
+    bakname[sizeof(bakname)-1] = 0;
+    bool backedup = false;
+    
+    if(exists(filename))
+    {
+        if(exists(bakname))
+            delete_file(bakname);
+            
+        if(rename(filename, bakname) != 0)
+        {
+            delete_file(tmpname);
+            return false;
+        }
+        
+        backedup = true;
+    }
+    
+    if(rename(tmpname, filename) != 0)
+    {
+        // Only drop the new data if the old file is safely back.
+        if(!backedup || rename(bakname, filename) == 0)
+            delete_file(tmpname);
+            
+        return false;
+    }
+    
+    if(backedup)
+        delete_file(bakname);
+        
+    return true;
+#else
+    ok = rename(tmpname, filename) == 0;
+    
+    if(!ok)
+        delete_file(tmpname);
+        
+    return ok;
+#endif
+}
+
+// Opens a read-only view of 'size' bytes at 'buf'. The caller keeps
+// ownership of the buffer, which must outlive the PACKFILE.
+PACKFILE *pack_fopen_memory(byte *buf, long size)
+{
+    return open_memory_packfile(NULL, buf, size);
+}
+
+//
+// Opens a decoded file held in memory the way pack_fopen_password() would
+// open the same bytes on disk, in F_READ_PACKED mode if 'packed' is set or
+// F_READ otherwise. On success the PACKFILE takes ownership of 'buf'. On
+// failure 'buf' is left as it was and errno is EDOM if the data isn't a
+// packfile, or EINVAL if it uses the old packfile encryption, which only
+// Allegro's own reader understands.
+//
+PACKFILE *pack_fopen_memory_password(byte *buf, long size, bool packed, const char *password)
+{
+    char pw[256];
+    strncpy(pw, password ? password : "", sizeof(pw)-1);
+    pw[sizeof(pw)-1] = 0;
+    
+    if(!packed)
+    {
+        packfile_xor(buf, size, pw);
+        PACKFILE *f = open_memory_packfile(buf, buf, size);
+        
+        if(!f)
+            packfile_xor(buf, size, pw);
+            
+        return f;
+    }
+    
+    if(size < 4)
+    {
+        errno = EDOM;
+        return NULL;
+    }
+    
+    // Allegro checks the header after decrypting it, old format included.
+    packfile_xor(buf, size, pw);
+    long header = ((long)buf[0] << 24) | ((long)buf[1] << 16) | ((long)buf[2] << 8) | (long)buf[3];
+    
+    if(pw[0] && (header == packfile_magic(F_PACK_MAGIC, pw, false) || header == packfile_magic(F_NOPACK_MAGIC, pw, false)))
+    {
+        packfile_xor(buf, size, pw);
+        errno = EINVAL;
+        return NULL;
+    }
+    
+    if(header == packfile_magic(F_NOPACK_MAGIC, pw, true))
+    {
+        PACKFILE *f = open_memory_packfile(buf, buf+4, size-4);
+        
+        if(!f)
+            packfile_xor(buf, size, pw);
+            
+        return f;
+    }
+    
+    if(header != packfile_magic(F_PACK_MAGIC, pw, true))
+    {
+        packfile_xor(buf, size, pw);
+        errno = EDOM;
+        return NULL;
+    }
+    
+    lzss_memory_packfile *lf = new lzss_memory_packfile;
+    lf->raw = open_memory_packfile(buf, buf+4, size-4);
+    lf->unpack = create_lzss_unpack_data();
+    lf->outpos = lf->outlen = 0;
+    lf->done = false;
+    PACKFILE *f = (lf->raw && lf->unpack) ? pack_fopen_vtable(&lzss_memory_vtable, lf) : NULL;
+    
+    if(!f)
+    {
+        if(lf->raw)
+        {
+            // Don't let the raw file free the caller's buffer.
+            ((memory_packfile *)lf->raw->userdata)->base = NULL;
+            pack_fclose(lf->raw);
+        }
+        
+        if(lf->unpack)
+            free_lzss_unpack_data(lf->unpack);
+            
+        delete lf;
+        packfile_xor(buf, size, pw);
+    }
+    
+    return f;
+}
+
 void copy_file(const char *src, const char *dest)
 {
     int c;
@@ -54,6 +54,12 @@ bool decode_007(byte *buf, dword size, dword key, word check1, word check2, int
 void encode_007(byte *buf, dword size, dword key, word *check1, word *check2, int method);
 int encode_file_007(const char *srcfile, const char *destfile, int key, const char *header, int method);
 int decode_file_007(const char *srcfile, const char *destfile, const char *header, int method, bool packed, const char *password);
+int decode_file_007_to_memory(const char *srcfile, byte **dest, long *destsize, const char *header, int method, bool packed, const char *password);
+PACKFILE *pack_fopen_memory_password(byte *buf, long size, bool packed, const char *password);
+PACKFILE *pack_fopen_memory(byte *buf, long size);
+PACKFILE *pack_fopen_memory_write(byte **dest, long *destsize, bool packed);
+int encode_memory_007(const byte *src, long size, byte **dest, long *destsize, int key2, const char *header, int method);
+bool write_file_atomic(const char *filename, const void *data, long size);
 void copy_file(const char *src, const char *dest);
 
 int  get_bit(byte *bitstr,int bit);